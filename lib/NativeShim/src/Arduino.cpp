@@ -0,0 +1,93 @@
+#include "Arduino.h"
+#include <mutex>
+#include <random>
+#include "NativeScheduler.h"
+
+HardwareSerial Serial;
+
+namespace {
+  bool g_serial_enabled = getenv("NATIVE_SERIAL") != nullptr;
+
+  std::mutex & RandomMutex(){ static std::mutex * mutex = new std::mutex(); return *mutex; }
+  std::mt19937 & Generator(){ static std::mt19937 * generator = new std::mt19937(12345); return *generator; }
+}
+
+uint32_t millis(){
+  return (uint32_t)(NativeScheduler::NowMicros() / 1000);
+}
+
+uint32_t micros(){
+  return (uint32_t)NativeScheduler::NowMicros();
+}
+
+void delay(uint32_t ms){
+  NativeScheduler::Sleep(ms);
+}
+
+void delayMicroseconds(uint32_t us){
+  NativeScheduler::Sleep((us + 999) / 1000);
+}
+
+void yield(){
+  NativeScheduler::Sleep(0);
+}
+
+long random(long howbig){
+  if(howbig <= 0){
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(RandomMutex());
+  return (long)(Generator()() % (unsigned long)howbig);
+}
+
+long random(long howsmall, long howbig){
+  if(howsmall >= howbig){
+    return howsmall;
+  }
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed){
+  std::lock_guard<std::mutex> lock(RandomMutex());
+  Generator().seed((std::mt19937::result_type)seed);
+}
+
+void HardwareSerial::begin(unsigned long baud){
+  (void)baud;
+}
+
+size_t HardwareSerial::printf(const char * format, ...){
+  va_list args;
+  va_start(args, format);
+  int length = 0;
+  if(g_serial_enabled){
+    length = vprintf(format, args);
+  }else{
+    length = vsnprintf(nullptr, 0, format, args);
+  }
+  va_end(args);
+  return length > 0 ? (size_t)length : 0;
+}
+
+size_t HardwareSerial::print(const char * str){ return printf("%s", str); }
+size_t HardwareSerial::print(const String & str){ return printf("%s", str.c_str()); }
+size_t HardwareSerial::print(char c){ return printf("%c", c); }
+size_t HardwareSerial::print(int value){ return printf("%d", value); }
+size_t HardwareSerial::print(unsigned int value){ return printf("%u", value); }
+size_t HardwareSerial::print(long value){ return printf("%ld", value); }
+size_t HardwareSerial::print(unsigned long value){ return printf("%lu", value); }
+size_t HardwareSerial::println(const char * str){ return printf("%s\r\n", str); }
+size_t HardwareSerial::println(const String & str){ return printf("%s\r\n", str.c_str()); }
+size_t HardwareSerial::write(uint8_t c){ return printf("%c", c); }
+
+void HardwareSerial::flush(){
+  fflush(stdout);
+}
+
+void NativeSerial::SetEnabled(bool enabled){
+  g_serial_enabled = enabled;
+}
+
+bool NativeSerial::IsEnabled(){
+  return g_serial_enabled;
+}
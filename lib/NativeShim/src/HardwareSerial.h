@@ -0,0 +1,34 @@
+// Serial of the Arduino core for the native test environment.
+// Output goes to stdout only if the environment variable NATIVE_SERIAL is set, so that test
+// results stay readable. NativeSerial::SetEnabled() switches it from a test.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "WString.h"
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+  size_t print(const char * str);
+  size_t print(const String & str);
+  size_t print(char c);
+  size_t print(int value);
+  size_t print(unsigned int value);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t println(const char * str = "");
+  size_t println(const String & str);
+  size_t write(uint8_t c);
+  void flush();
+};
+
+extern HardwareSerial Serial;
+
+class NativeSerial {
+public:
+  static void SetEnabled(bool enabled);
+  static bool IsEnabled();
+};
@@ -0,0 +1,31 @@
+// IPAddress class of the Arduino-ESP32 core for the native test environment.
+// The address is stored in network order like on the device, so (uint32_t)IPAddress(192,168,1,40)
+// gives the same value on both.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include "WString.h"
+
+class IPAddress {
+public:
+  IPAddress() : m_address(0) {}
+  IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+    : m_address((uint32_t)first | ((uint32_t)second << 8) | ((uint32_t)third << 16) | ((uint32_t)fourth << 24)) {}
+  IPAddress(uint32_t address) : m_address(address) {}
+
+  operator uint32_t() const { return m_address; }
+  bool operator==(const IPAddress & rhs) const { return m_address == rhs.m_address; }
+  bool operator!=(const IPAddress & rhs) const { return m_address != rhs.m_address; }
+  uint8_t operator[](int index) const { return (uint8_t)(m_address >> (8 * index)); }
+
+  String toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buffer);
+  }
+
+private:
+  uint32_t m_address;
+};
@@ -0,0 +1,394 @@
+#include "NativeHeap.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <sched.h>
+#include <errno.h>
+
+#ifndef NATIVE_HEAP_SIZE
+#define NATIVE_HEAP_SIZE (2 * 1024 * 1024)
+#endif
+
+extern "C" {
+  void * __libc_malloc(size_t size);
+  void   __libc_free(void * ptr);
+  void * __libc_calloc(size_t count, size_t size);
+  void * __libc_realloc(void * ptr, size_t size);
+  void * __libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+  // A block is a header followed by the payload. The payload is followed by guard bytes up
+  // to the end of the block. A free block keeps the links of the free list in its payload.
+  struct HEADER {
+    uint32_t size;      // bytes of the whole block
+    uint32_t prev_size; // bytes of the block before this one. 0 for the first block
+    uint32_t requested; // bytes asked by the caller
+    uint32_t flags;
+  };
+
+  struct FREE_LINKS {
+    HEADER * next;
+    HEADER * prev;
+  };
+
+  const uint32_t FLAG_USED  = 0x1;
+  const uint32_t MAGIC      = 0x48454100; // "HEA"
+  const uint32_t MAGIC_MASK = 0xFFFFFF00;
+  const size_t   ALIGNMENT  = 16;
+  const size_t   GUARD_SIZE = 8;
+  const size_t   MIN_BLOCK  = sizeof(HEADER) + sizeof(FREE_LINKS);
+  const uint8_t  GUARD_BYTE = 0xFD;
+
+  alignas(16) uint8_t g_arena[NATIVE_HEAP_SIZE];
+  bool g_initialized = false;
+  HEADER * g_free_list = nullptr;
+  std::atomic_flag g_lock = ATOMIC_FLAG_INIT;
+  NativeHeap::STATS g_stats;
+
+  class Lock {
+  public:
+    Lock(){
+      while(g_lock.test_and_set(std::memory_order_acquire)){
+        sched_yield();
+      }
+    }
+    ~Lock(){
+      g_lock.clear(std::memory_order_release);
+    }
+  };
+
+  bool InArena(const void * ptr){
+    return (const uint8_t *)ptr >= g_arena && (const uint8_t *)ptr < g_arena + sizeof(g_arena);
+  }
+
+  FREE_LINKS * Links(HEADER * block){
+    return (FREE_LINKS *)(block + 1);
+  }
+
+  HEADER * Next(HEADER * block){
+    uint8_t * next = (uint8_t *)block + block->size;
+    return next < g_arena + sizeof(g_arena) ? (HEADER *)next : nullptr;
+  }
+
+  HEADER * Prev(HEADER * block){
+    return block->prev_size == 0 ? nullptr : (HEADER *)((uint8_t *)block - block->prev_size);
+  }
+
+  bool IsUsed(const HEADER * block){
+    return (block->flags & FLAG_USED) != 0;
+  }
+
+  void Unlink(HEADER * block){
+    FREE_LINKS * links = Links(block);
+    if(links->prev != nullptr){
+      Links(links->prev)->next = links->next;
+    }else{
+      g_free_list = links->next;
+    }
+    if(links->next != nullptr){
+      Links(links->next)->prev = links->prev;
+    }
+    g_stats.free -= block->size;
+    g_stats.free_blocks--;
+  }
+
+  void Link(HEADER * block){
+    block->flags = MAGIC;
+    block->requested = 0;
+    FREE_LINKS * links = Links(block);
+    links->prev = nullptr;
+    links->next = g_free_list;
+    if(g_free_list != nullptr){
+      Links(g_free_list)->prev = block;
+    }
+    g_free_list = block;
+    g_stats.free += block->size;
+    g_stats.free_blocks++;
+  }
+
+  void Initialize(){
+    if(g_initialized){
+      return;
+    }
+    g_initialized = true;
+    HEADER * block = (HEADER *)g_arena;
+    block->size = sizeof(g_arena);
+    block->prev_size = 0;
+    g_stats.size = sizeof(g_arena);
+    Link(block);
+    g_stats.minimum_free = g_stats.free;
+  }
+
+  size_t BlockSize(size_t requested){
+    size_t size = sizeof(HEADER) + requested + GUARD_SIZE;
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    return size < MIN_BLOCK ? MIN_BLOCK : size;
+  }
+
+  void FillGuard(HEADER * block){
+    uint8_t * payload = (uint8_t *)(block + 1);
+    memset(payload + block->requested, GUARD_BYTE, block->size - sizeof(HEADER) - block->requested);
+  }
+
+  bool CheckGuard(const HEADER * block){
+    const uint8_t * payload = (const uint8_t *)(block + 1);
+    const size_t guard = block->size - sizeof(HEADER) - block->requested;
+    for(size_t i = 0; i < guard; i++){
+      if(payload[block->requested + i] != GUARD_BYTE){
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Corrupted(const char * what, const void * ptr){
+    // fprintf may allocate, so the message is written directly.
+    char message[128];
+    const int length = snprintf(message, sizeof(message), "(HEAP)%s at %p\n", what, ptr);
+    if(length > 0){
+      fwrite(message, 1, (size_t)length, stderr);
+    }
+    abort();
+  }
+
+  void * ArenaAlloc(size_t requested){
+    if(requested > sizeof(g_arena)){
+      return nullptr;
+    }
+    const size_t need = BlockSize(requested);
+
+    HEADER * block = g_free_list;
+    while(block != nullptr && block->size < need){
+      block = Links(block)->next;
+    }
+    if(block == nullptr){
+      return nullptr;
+    }
+
+    Unlink(block);
+    if(block->size - need >= MIN_BLOCK){
+      HEADER * rest = (HEADER *)((uint8_t *)block + need);
+      rest->size = block->size - (uint32_t)need;
+      rest->prev_size = (uint32_t)need;
+      HEADER * after = Next(rest);
+      if(after != nullptr){
+        after->prev_size = rest->size;
+      }
+      block->size = (uint32_t)need;
+      Link(rest);
+    }
+
+    block->flags = MAGIC | FLAG_USED;
+    block->requested = (uint32_t)requested;
+    FillGuard(block);
+
+    g_stats.in_use += requested;
+    g_stats.live_blocks++;
+    g_stats.allocations++;
+    g_stats.allocated_bytes += requested;
+    if(g_stats.in_use > g_stats.peak_in_use){
+      g_stats.peak_in_use = g_stats.in_use;
+    }
+    if(g_stats.free < g_stats.minimum_free){
+      g_stats.minimum_free = g_stats.free;
+    }
+    return block + 1;
+  }
+
+  HEADER * UsedHeader(void * ptr){
+    HEADER * block = (HEADER *)ptr - 1;
+    if((block->flags & MAGIC_MASK) != MAGIC || !IsUsed(block)){
+      Corrupted("Invalid free", ptr);
+    }
+    if(!CheckGuard(block)){
+      Corrupted("Overflow", ptr);
+    }
+    return block;
+  }
+
+  void ArenaFree(void * ptr){
+    HEADER * block = UsedHeader(ptr);
+    g_stats.in_use -= block->requested;
+    g_stats.live_blocks--;
+
+    HEADER * next = Next(block);
+    if(next != nullptr && !IsUsed(next)){
+      Unlink(next);
+      block->size += next->size;
+    }
+    HEADER * prev = Prev(block);
+    if(prev != nullptr && !IsUsed(prev)){
+      Unlink(prev);
+      prev->size += block->size;
+      block = prev;
+    }
+    next = Next(block);
+    if(next != nullptr){
+      next->prev_size = block->size;
+    }
+    Link(block);
+  }
+}
+
+extern "C" {
+
+void * malloc(size_t size){
+  {
+    Lock lock;
+    Initialize();
+    void * ptr = ArenaAlloc(size);
+    if(ptr != nullptr){
+      return ptr;
+    }
+    g_stats.fallback_allocations++;
+  }
+  return __libc_malloc(size);
+}
+
+void free(void * ptr){
+  if(ptr == nullptr){
+    return;
+  }
+  if(!InArena(ptr)){
+    __libc_free(ptr);
+    return;
+  }
+  Lock lock;
+  ArenaFree(ptr);
+}
+
+void * calloc(size_t count, size_t size){
+  if(size != 0 && count > (size_t)-1 / size){
+    errno = ENOMEM;
+    return nullptr;
+  }
+  void * ptr = malloc(count * size);
+  if(ptr != nullptr){
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void * realloc(void * ptr, size_t size){
+  if(ptr == nullptr){
+    return malloc(size);
+  }
+  if(!InArena(ptr)){
+    return __libc_realloc(ptr, size);
+  }
+  if(size == 0){
+    free(ptr);
+    return nullptr;
+  }
+
+  size_t old_size;
+  {
+    Lock lock;
+    HEADER * block = UsedHeader(ptr);
+    old_size = block->requested;
+    if(BlockSize(size) <= block->size){
+      g_stats.in_use = g_stats.in_use - block->requested + size;
+      block->requested = (uint32_t)size;
+      FillGuard(block);
+      if(g_stats.in_use > g_stats.peak_in_use){
+        g_stats.peak_in_use = g_stats.in_use;
+      }
+      return ptr;
+    }
+  }
+
+  void * moved = malloc(size);
+  if(moved == nullptr){
+    return nullptr;
+  }
+  memcpy(moved, ptr, old_size < size ? old_size : size);
+  free(ptr);
+  return moved;
+}
+
+void * reallocarray(void * ptr, size_t count, size_t size){
+  if(size != 0 && count > (size_t)-1 / size){
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(ptr, count * size);
+}
+
+void * memalign(size_t alignment, size_t size){
+  if(alignment <= ALIGNMENT){
+    return malloc(size);
+  }
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void ** out, size_t alignment, size_t size){
+  void * ptr = memalign(alignment, size);
+  if(ptr == nullptr){
+    return ENOMEM;
+  }
+  *out = ptr;
+  return 0;
+}
+
+void * aligned_alloc(size_t alignment, size_t size){
+  return memalign(alignment, size);
+}
+
+void * valloc(size_t size){
+  return __libc_memalign(4096, size);
+}
+
+void * pvalloc(size_t size){
+  return __libc_memalign(4096, (size + 4095) & ~(size_t)4095);
+}
+
+size_t malloc_usable_size(void * ptr){
+  if(ptr == nullptr){
+    return 0;
+  }
+  if(InArena(ptr)){
+    Lock lock;
+    return UsedHeader(ptr)->requested;
+  }
+  typedef size_t (*USABLE_SIZE)(void *);
+  static USABLE_SIZE libc_usable_size = (USABLE_SIZE)dlsym(RTLD_NEXT, "malloc_usable_size");
+  return libc_usable_size != nullptr ? libc_usable_size(ptr) : 0;
+}
+
+}
+
+NativeHeap::STATS NativeHeap::GetStats(){
+  Lock lock;
+  Initialize();
+  STATS stats = g_stats;
+  stats.largest_free_block = 0;
+  for(HEADER * block = g_free_list; block != nullptr; block = Links(block)->next){
+    const size_t usable = block->size - sizeof(HEADER) - GUARD_SIZE;
+    if(usable > stats.largest_free_block){
+      stats.largest_free_block = usable;
+    }
+  }
+  return stats;
+}
+
+void NativeHeap::ResetPeak(){
+  Lock lock;
+  g_stats.peak_in_use = g_stats.in_use;
+}
+
+bool NativeHeap::Verify(){
+  Lock lock;
+  Initialize();
+  for(HEADER * block = (HEADER *)g_arena; block != nullptr; block = Next(block)){
+    if((block->flags & MAGIC_MASK) != MAGIC){
+      return false;
+    }
+    if(IsUsed(block) && !CheckGuard(block)){
+      return false;
+    }
+  }
+  return true;
+}
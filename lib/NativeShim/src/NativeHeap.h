@@ -0,0 +1,47 @@
+// NativeHeap class reports the allocator hook of the native test environment.
+//
+// malloc, free, calloc and realloc of the test program are served from a fixed arena with a
+// first-fit allocator. Freed blocks are merged with free neighbors, so fragmentation shows
+// up in largest_free_block as it does on the device heap.
+// Each block ends with guard bytes. They are checked by free() and by Verify(), and the
+// program aborts when one was overwritten.
+//
+// Usage:
+//   NativeHeap::STATS before = NativeHeap::GetStats();
+//   ...
+//   NativeHeap::STATS after = NativeHeap::GetStats();
+//   after.in_use - before.in_use;
+//
+// Note:
+// Allocations that do not fit the arena fall back to the C library and are counted in
+// fallback_allocations. Tests treat them as a failure.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class NativeHeap {
+public:
+  struct STATS {
+    size_t   size = 0;                 // bytes of the arena
+    size_t   in_use = 0;               // requested bytes of live blocks
+    size_t   peak_in_use = 0;          // highest in_use since ResetPeak()
+    size_t   free = 0;                 // bytes of free blocks
+    size_t   minimum_free = 0;         // lowest free since start
+    size_t   largest_free_block = 0;
+    size_t   live_blocks = 0;
+    size_t   free_blocks = 0;
+    uint64_t allocations = 0;          // number of malloc calls since start
+    uint64_t allocated_bytes = 0;      // requested bytes of all malloc calls since start
+    uint64_t fallback_allocations = 0;
+  };
+
+  static STATS GetStats();
+
+  /// ResetPeak sets peak_in_use to the current in_use.
+  static void ResetPeak();
+
+  /// @return false if a guard byte of a live block was overwritten.
+  static bool Verify();
+};
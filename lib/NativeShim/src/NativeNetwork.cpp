@@ -0,0 +1,205 @@
+#include "NativeNetwork.h"
+#include <map>
+#include "NativeScheduler.h"
+
+namespace {
+  struct REGISTRY {
+    std::mutex mutex;
+    std::map<uint64_t, std::shared_ptr<NativeServer>> servers;
+    std::vector<NativeNetwork::UDP_RESPONDER> responders;
+    wl_status_t status = WL_CONNECTED;
+    uint32_t connect_timeout_ms = 100;
+  };
+
+  REGISTRY & Registry(){
+    static REGISTRY * registry = new REGISTRY();
+    return *registry;
+  }
+
+  uint64_t Key(IPAddress address, uint16_t port){
+    return ((uint64_t)(uint32_t)address << 16) | port;
+  }
+}
+
+NativeConnection::NativeConnection(const std::shared_ptr<NativeServer> & server, IPAddress address, uint16_t port)
+  : m_server(server), m_address(address), m_port(port) {}
+
+void NativeConnection::Send(const std::string & data, uint32_t delay_ms){
+  const uint64_t due_us = NativeScheduler::NowMicros() + (uint64_t)delay_ms * 1000;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if(!m_open){
+    return;
+  }
+  // Data is delivered in order even if a later Send() has a shorter delay.
+  const uint64_t last_us = m_chunks.empty() ? 0 : m_chunks.back().due_us;
+  m_chunks.push_back(CHUNK{ due_us > last_us ? due_us : last_us, data });
+}
+
+void NativeConnection::Close(){
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_open = false;
+}
+
+size_t NativeConnection::Available(){
+  const uint64_t now_us = NativeScheduler::NowMicros();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  size_t available = 0;
+  size_t offset = m_offset;
+  for(const CHUNK & chunk : m_chunks){
+    if(chunk.due_us > now_us){
+      break;
+    }
+    available += chunk.data.size() - offset;
+    offset = 0;
+  }
+  return available;
+}
+
+int NativeConnection::Read(){
+  const uint64_t now_us = NativeScheduler::NowMicros();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  while(!m_chunks.empty() && m_chunks.front().due_us <= now_us){
+    const std::string & data = m_chunks.front().data;
+    if(m_offset < data.size()){
+      return (uint8_t)data[m_offset++];
+    }
+    m_chunks.pop_front();
+    m_offset = 0;
+  }
+  return -1;
+}
+
+bool NativeConnection::PopFrame(std::string & frame){
+  const uint64_t now_us = NativeScheduler::NowMicros();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if(m_chunks.empty() || m_chunks.front().due_us > now_us){
+    return false;
+  }
+  frame = m_chunks.front().data;
+  m_chunks.pop_front();
+  return true;
+}
+
+void NativeConnection::Write(const std::string & data){
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_open){
+      return;
+    }
+  }
+  m_server->OnReceive(shared_from_this(), data);
+}
+
+void NativeConnection::Stop(){
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!m_open){
+      return;
+    }
+    m_open = false;
+  }
+  m_server->OnClose(shared_from_this());
+}
+
+bool NativeConnection::IsOpen(){
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_open;
+}
+
+bool NativeConnection::HasPendingData(){
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return !m_chunks.empty();
+}
+
+void NativeConnection::SetNoDelay(bool nodelay){
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_nodelay = nodelay;
+}
+
+bool NativeConnection::GetNoDelay(){
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_nodelay;
+}
+
+void NativeNetwork::Listen(IPAddress address, uint16_t port, const std::shared_ptr<NativeServer> & server){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.servers[Key(address, port)] = server;
+}
+
+void NativeNetwork::StopListening(IPAddress address, uint16_t port){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.servers.erase(Key(address, port));
+}
+
+std::shared_ptr<NativeConnection> NativeNetwork::Connect(IPAddress address, uint16_t port){
+  std::shared_ptr<NativeServer> server;
+  uint32_t timeout_ms;
+  {
+    REGISTRY & registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto found = registry.servers.find(Key(address, port));
+    if(found != registry.servers.end() && registry.status == WL_CONNECTED){
+      server = found->second;
+    }
+    timeout_ms = registry.connect_timeout_ms;
+  }
+
+  if(server){
+    auto connection = std::make_shared<NativeConnection>(server, address, port);
+    if(server->OnConnect(connection)){
+      return connection;
+    }
+  }
+  NativeScheduler::Sleep(timeout_ms);
+  return nullptr;
+}
+
+void NativeNetwork::AddUdpResponder(const UDP_RESPONDER & responder){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.responders.push_back(responder);
+}
+
+void NativeNetwork::SendUdp(IPAddress to, uint16_t port, const std::string & request, std::vector<UDP_REPLY> & replies){
+  std::vector<UDP_RESPONDER> responders;
+  {
+    REGISTRY & registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if(registry.status != WL_CONNECTED){
+      return;
+    }
+    responders = registry.responders;
+  }
+  for(auto & responder : responders){
+    responder(to, port, request, replies);
+  }
+}
+
+void NativeNetwork::SetWiFiStatus(wl_status_t status){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.status = status;
+}
+
+wl_status_t NativeNetwork::GetWiFiStatus(){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  return registry.status;
+}
+
+void NativeNetwork::SetConnectTimeout(uint32_t timeout_ms){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.connect_timeout_ms = timeout_ms;
+}
+
+void NativeNetwork::Reset(){
+  REGISTRY & registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.servers.clear();
+  registry.responders.clear();
+  registry.status = WL_CONNECTED;
+  registry.connect_timeout_ms = 100;
+}
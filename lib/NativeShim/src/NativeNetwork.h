@@ -0,0 +1,145 @@
+// NativeNetwork class connects WiFiClient, WebSocketsClient and WiFiUDP of the native test
+// environment to mock servers in the same process.
+//
+// Usage:
+// 1. Implement NativeServer
+//   class EchoServer : public NativeServer {
+//     void OnReceive(const std::shared_ptr<NativeConnection> & connection, const std::string & data) override {
+//       connection->Send(data, 20); // readable by the client 20 ms later
+//     }
+//   };
+// 2. Listen on an address
+//   NativeNetwork::Listen(IPAddress(192,168,1,40), 1255, std::make_shared<EchoServer>());
+// 3. Connect with WiFiClient or WebSocketsClient as on the device
+//
+// Note:
+// Server callbacks are called from the task that writes, connects or closes.
+// Data sent by a server becomes readable when virtual time reaches its delay.
+// A WebSocket text frame is one Send() call. A TCP read may span several Send() calls.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "IPAddress.h"
+
+typedef enum {
+  WL_NO_SHIELD       = 255,
+  WL_IDLE_STATUS     = 0,
+  WL_NO_SSID_AVAIL   = 1,
+  WL_SCAN_COMPLETED  = 2,
+  WL_CONNECTED       = 3,
+  WL_CONNECT_FAILED  = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED    = 6
+} wl_status_t;
+
+class NativeServer;
+
+// NativeConnection is one TCP connection or WebSocket session.
+class NativeConnection : public std::enable_shared_from_this<NativeConnection> {
+public:
+  NativeConnection(const std::shared_ptr<NativeServer> & server, IPAddress address, uint16_t port);
+
+  //----- Server side -----//
+  /// Send queues data for the client. It becomes readable after delay_ms of virtual time.
+  void Send(const std::string & data, uint32_t delay_ms = 0);
+
+  /// Close closes the connection from the server side. Queued data can still be read.
+  void Close();
+
+  //----- Client side -----//
+  /// @return number of bytes readable now.
+  size_t Available();
+  /// @return next byte or -1.
+  int Read();
+  /// PopFrame takes the next readable Send() call as a whole.
+  /// @return false if none is readable now.
+  bool PopFrame(std::string & frame);
+  /// Write passes data to the server.
+  void Write(const std::string & data);
+  /// Stop closes the connection from the client side.
+  void Stop();
+
+  //----- Both -----//
+  /// @return false after Close() or Stop().
+  bool IsOpen();
+  /// @return true if readable data is left or may still arrive.
+  bool HasPendingData();
+  IPAddress GetAddress() const { return m_address; }
+  uint16_t GetPort() const { return m_port; }
+  void SetNoDelay(bool nodelay);
+  bool GetNoDelay();
+  std::shared_ptr<NativeServer> GetServer() const { return m_server; }
+
+private:
+  struct CHUNK {
+    uint64_t due_us;
+    std::string data;
+  };
+
+  std::mutex m_mutex;
+  std::shared_ptr<NativeServer> m_server;
+  IPAddress m_address;
+  uint16_t m_port;
+  std::deque<CHUNK> m_chunks;
+  size_t m_offset = 0; // bytes of m_chunks.front() already read
+  bool m_open = true;
+  bool m_nodelay = false;
+};
+
+// NativeServer is the base class of mock servers.
+class NativeServer {
+public:
+  virtual ~NativeServer() {}
+
+  /// @return false to refuse the connection.
+  virtual bool OnConnect(const std::shared_ptr<NativeConnection> & connection) { (void)connection; return true; }
+
+  /// OnReceive is called with each write of a TCP client and each text frame of a WebSocket client.
+  virtual void OnReceive(const std::shared_ptr<NativeConnection> & connection, const std::string & data) = 0;
+
+  /// OnClose is called when the client closes the connection.
+  virtual void OnClose(const std::shared_ptr<NativeConnection> & connection) { (void)connection; }
+
+  /// @return false to stop answering WebSocket pings like a half-open connection.
+  virtual bool AnswersPing() { return true; }
+};
+
+class NativeNetwork {
+public:
+  struct UDP_REPLY {
+    IPAddress from;
+    uint16_t port;
+    std::string data;
+    uint32_t delay_ms;
+  };
+
+  /// A UDP responder gets each datagram sent by WiFiUDP and may add replies to it.
+  typedef std::function<void(IPAddress to, uint16_t port, const std::string & request, std::vector<UDP_REPLY> & replies)> UDP_RESPONDER;
+
+  static void Listen(IPAddress address, uint16_t port, const std::shared_ptr<NativeServer> & server);
+  static void StopListening(IPAddress address, uint16_t port);
+
+  /// Connect opens a connection to the server listening on address and port.
+  /// A failed attempt takes the connect timeout of virtual time.
+  /// @return nullptr if nothing listens there or the server refused.
+  static std::shared_ptr<NativeConnection> Connect(IPAddress address, uint16_t port);
+
+  static void AddUdpResponder(const UDP_RESPONDER & responder);
+  static void SendUdp(IPAddress to, uint16_t port, const std::string & request, std::vector<UDP_REPLY> & replies);
+
+  static void SetWiFiStatus(wl_status_t status);
+  static wl_status_t GetWiFiStatus();
+
+  /// SetConnectTimeout sets the virtual time a failed connect takes. 100 ms by default.
+  static void SetConnectTimeout(uint32_t timeout_ms);
+
+  /// Reset removes servers and responders and sets WL_CONNECTED.
+  static void Reset();
+};
@@ -0,0 +1,317 @@
+#include "NativeScheduler.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+struct NativeTask {
+  TaskFunction_t code = nullptr;
+  void * parameters = nullptr;
+  char name[32] = {};
+  uint8_t * mapping = nullptr;
+  size_t mapping_size = 0;
+  uint8_t * stack = nullptr;
+  size_t stack_size = 0;
+  void * heap_block = nullptr; // stands for the TCB and the stack that the device takes from the heap
+  pthread_t thread;
+  bool finished = false;
+};
+
+struct NativeSemaphore {
+  UBaseType_t count;
+  UBaseType_t max_count;
+};
+
+namespace {
+  struct WAITER {
+    uint64_t wake_us;             // UINT64_MAX if it waits without timeout
+    NativeSemaphore * semaphore;  // nullptr for delay()
+    bool woken = false;
+    bool acquired = false;
+    std::condition_variable cv;
+  };
+
+  const uint8_t  STACK_FILL = 0xA5;
+  const size_t   HOST_STACK_FACTOR = 8;
+  const size_t   MIN_HOST_STACK = 64 * 1024;
+  const uint32_t TCB_SIZE = 352;
+
+  // These live until exit so that tasks still running at exit do not touch destroyed objects.
+  std::mutex & Mutex(){ static std::mutex * mutex = new std::mutex(); return *mutex; }
+  std::vector<WAITER *> & Waiters(){ static auto * waiters = new std::vector<WAITER *>(); return *waiters; }
+  std::vector<NativeTask *> & Tasks(){ static auto * tasks = new std::vector<NativeTask *>(); return *tasks; }
+
+  uint64_t g_now_us = 1000;
+  int g_running = 1; // the main thread runs from the start
+  int g_finished = 0;
+  thread_local NativeTask * t_task = nullptr;
+
+  void Wake(WAITER * waiter){
+    waiter->woken = true;
+    g_running++;
+    waiter->cv.notify_one();
+  }
+
+  // Advance is called with the mutex held after a task stopped running.
+  // When no task runs, it moves the clock to the earliest wake-up time and wakes those tasks.
+  void Advance(){
+    if(g_running > 0){
+      return;
+    }
+    uint64_t next_us = UINT64_MAX;
+    for(WAITER * waiter : Waiters()){
+      if(!waiter->woken && waiter->wake_us < next_us){
+        next_us = waiter->wake_us;
+      }
+    }
+    if(next_us == UINT64_MAX){
+      fprintf(stderr, "(SCHED)Deadlock: every task waits without timeout\n");
+      abort();
+    }
+    if(next_us > g_now_us){
+      g_now_us = next_us;
+    }
+    for(WAITER * waiter : Waiters()){
+      if(!waiter->woken && waiter->wake_us <= g_now_us){
+        Wake(waiter);
+      }
+    }
+  }
+
+  void Block(std::unique_lock<std::mutex> & lock, WAITER & waiter){
+    Waiters().push_back(&waiter);
+    g_running--;
+    Advance();
+    while(!waiter.woken){
+      waiter.cv.wait(lock);
+    }
+    auto & waiters = Waiters();
+    waiters.erase(std::find(waiters.begin(), waiters.end(), &waiter));
+  }
+
+  // Reap joins ended tasks and releases their stacks.
+  void Reap(){
+    std::vector<NativeTask *> ended;
+    {
+      std::lock_guard<std::mutex> lock(Mutex());
+      if(g_finished == 0){
+        return;
+      }
+      auto & tasks = Tasks();
+      for(auto it = tasks.begin(); it != tasks.end();){
+        if((*it)->finished){
+          ended.push_back(*it);
+          it = tasks.erase(it);
+        }else{
+          ++it;
+        }
+      }
+      g_finished -= (int)ended.size();
+    }
+    for(NativeTask * task : ended){
+      pthread_join(task->thread, nullptr);
+      munmap(task->mapping, task->mapping_size);
+      free(task->heap_block);
+      delete task;
+    }
+  }
+
+  void EndTask(){
+    {
+      std::lock_guard<std::mutex> lock(Mutex());
+      t_task->finished = true;
+      g_finished++;
+      g_running--;
+      if(g_running == 0 && !Waiters().empty()){
+        Advance();
+      }
+    }
+    pthread_exit(nullptr);
+  }
+
+  void * Trampoline(void * parameter){
+    t_task = (NativeTask *)parameter;
+    t_task->code(t_task->parameters);
+    EndTask();
+    return nullptr;
+  }
+}
+
+uint64_t NativeScheduler::NowMicros(){
+  std::lock_guard<std::mutex> lock(Mutex());
+  return g_now_us;
+}
+
+void NativeScheduler::Sleep(uint32_t ms){
+  Reap();
+  if(ms == 0){
+    sched_yield();
+    return;
+  }
+  std::unique_lock<std::mutex> lock(Mutex());
+  WAITER waiter;
+  waiter.wake_us = g_now_us + (uint64_t)ms * 1000;
+  waiter.semaphore = nullptr;
+  Block(lock, waiter);
+}
+
+int NativeScheduler::GetTaskCount(){
+  std::lock_guard<std::mutex> lock(Mutex());
+  int count = 0;
+  for(NativeTask * task : Tasks()){
+    count += task->finished ? 0 : 1;
+  }
+  return count;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char * pcName, uint32_t usStackDepth,
+                                   void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pvCreatedTask,
+                                   BaseType_t xCoreID){
+  (void)uxPriority;
+  (void)xCoreID;
+  Reap();
+
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t stack_size = std::max((size_t)usStackDepth * HOST_STACK_FACTOR, MIN_HOST_STACK);
+  stack_size = (stack_size + page - 1) / page * page;
+
+  NativeTask * task = new NativeTask();
+  task->code = pvTaskCode;
+  task->parameters = pvParameters;
+  strncpy(task->name, pcName != nullptr ? pcName : "", sizeof(task->name) - 1);
+  task->mapping_size = stack_size + page;
+  task->mapping = (uint8_t *)mmap(nullptr, task->mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if(task->mapping == MAP_FAILED){
+    delete task;
+    return pdFAIL;
+  }
+  // The lowest page stays unmapped so that a stack overflow crashes instead of corrupting memory.
+  mprotect(task->mapping, page, PROT_NONE);
+  task->stack = task->mapping + page;
+  task->stack_size = stack_size;
+  memset(task->stack, STACK_FILL, stack_size);
+  task->heap_block = malloc(usStackDepth + TCB_SIZE);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, task->stack, task->stack_size);
+
+  {
+    std::lock_guard<std::mutex> lock(Mutex());
+    g_running++;
+    Tasks().push_back(task);
+  }
+  const int error = pthread_create(&task->thread, &attr, Trampoline, task);
+  pthread_attr_destroy(&attr);
+  if(error != 0){
+    {
+      std::lock_guard<std::mutex> lock(Mutex());
+      g_running--;
+      auto & tasks = Tasks();
+      tasks.erase(std::find(tasks.begin(), tasks.end(), task));
+    }
+    munmap(task->mapping, task->mapping_size);
+    free(task->heap_block);
+    delete task;
+    return pdFAIL;
+  }
+
+  if(pvCreatedTask != nullptr){
+    *pvCreatedTask = task;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char * pcName, uint32_t usStackDepth,
+                       void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pvCreatedTask){
+  return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pvCreatedTask, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTask){
+  if(t_task == nullptr || (xTask != nullptr && xTask != t_task)){
+    fprintf(stderr, "(SCHED)vTaskDelete supports only the calling task\n");
+    abort();
+  }
+  EndTask();
+}
+
+void vTaskDelay(TickType_t xTicksToDelay){
+  NativeScheduler::Sleep(xTicksToDelay * portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(){
+  return t_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask){
+  NativeTask * task = xTask != nullptr ? xTask : t_task;
+  if(task == nullptr){
+    return 0;
+  }
+  // The stack grows down, so bytes never touched are at the low end.
+  size_t untouched = 0;
+  while(untouched < task->stack_size && task->stack[untouched] == STACK_FILL){
+    untouched++;
+  }
+  return (UBaseType_t)untouched;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount){
+  NativeSemaphore * semaphore = new NativeSemaphore();
+  semaphore->count = uxInitialCount;
+  semaphore->max_count = uxMaxCount;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(){
+  return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(){
+  return xSemaphoreCreateCounting(1, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore){
+  delete xSemaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait){
+  std::unique_lock<std::mutex> lock(Mutex());
+  if(xSemaphore->count > 0){
+    xSemaphore->count--;
+    return pdTRUE;
+  }
+  if(xTicksToWait == 0){
+    return pdFALSE;
+  }
+  WAITER waiter;
+  waiter.wake_us = xTicksToWait == portMAX_DELAY ? UINT64_MAX : g_now_us + (uint64_t)xTicksToWait * portTICK_PERIOD_MS * 1000;
+  waiter.semaphore = xSemaphore;
+  Block(lock, waiter);
+  return waiter.acquired ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore){
+  std::lock_guard<std::mutex> lock(Mutex());
+  for(WAITER * waiter : Waiters()){
+    if(waiter->semaphore == xSemaphore && !waiter->woken){
+      waiter->acquired = true;
+      Wake(waiter);
+      return pdTRUE;
+    }
+  }
+  if(xSemaphore->count >= xSemaphore->max_count){
+    return pdFALSE;
+  }
+  xSemaphore->count++;
+  return pdTRUE;
+}
@@ -0,0 +1,32 @@
+// NativeScheduler class runs tasks on virtual time in the native test environment.
+//
+// Each FreeRTOS task is a host thread. A task that calls delay() or waits on a semaphore
+// sleeps until virtual time reaches its wake-up time. Virtual time moves forward only when
+// every task sleeps, and then it jumps to the earliest wake-up time.
+// So a timeout of 500 ms costs no host time, and elapsed times measured by millis() do not
+// depend on host speed.
+//
+// Usage:
+//   const uint32_t start = millis();
+//   delay(100);                        // other tasks run meanwhile
+//   millis() - start;                  // 100
+//
+// Note:
+// A task that spins without delay() stops virtual time for every other task.
+// If every task waits on a semaphore without timeout, the program aborts with a message.
+
+#pragma once
+
+#include <cstdint>
+
+class NativeScheduler {
+public:
+  /// @return virtual time in microseconds since start.
+  static uint64_t NowMicros();
+
+  /// Sleep blocks the calling thread for ms of virtual time.
+  static void Sleep(uint32_t ms);
+
+  /// @return number of tasks created by xTaskCreate* that have not ended yet.
+  static int GetTaskCount();
+};
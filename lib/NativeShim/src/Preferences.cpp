@@ -0,0 +1,97 @@
+#include "Preferences.h"
+#include <map>
+#include <mutex>
+
+namespace {
+  struct STORE {
+    std::mutex mutex;
+    std::map<std::string, std::map<std::string, std::string>> namespaces;
+  };
+
+  STORE & Store(){
+    static STORE * store = new STORE();
+    return *store;
+  }
+}
+
+bool Preferences::begin(const char * name, bool readOnly, const char * partition_label){
+  (void)partition_label;
+  m_name = name;
+  m_read_only = readOnly;
+  m_started = true;
+  return true;
+}
+
+void Preferences::end(){
+  m_started = false;
+}
+
+bool Preferences::clear(){
+  if(!m_started || m_read_only){
+    return false;
+  }
+  STORE & store = Store();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  store.namespaces[m_name].clear();
+  return true;
+}
+
+bool Preferences::remove(const char * key){
+  if(!m_started || m_read_only){
+    return false;
+  }
+  STORE & store = Store();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  return store.namespaces[m_name].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char * key){
+  if(!m_started){
+    return false;
+  }
+  STORE & store = Store();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  return store.namespaces[m_name].count(key) > 0;
+}
+
+size_t Preferences::putUInt(const char * key, uint32_t value){
+  return putString(key, String(value));
+}
+
+uint32_t Preferences::getUInt(const char * key, uint32_t defaultValue){
+  if(!isKey(key)){
+    return defaultValue;
+  }
+  return (uint32_t)strtoul(getString(key).c_str(), nullptr, 10);
+}
+
+size_t Preferences::putString(const char * key, const char * value){
+  if(!m_started || m_read_only){
+    return 0;
+  }
+  STORE & store = Store();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  store.namespaces[m_name][key] = value;
+  return strlen(value);
+}
+
+size_t Preferences::putString(const char * key, String value){
+  return putString(key, value.c_str());
+}
+
+String Preferences::getString(const char * key, String defaultValue){
+  if(!m_started){
+    return defaultValue;
+  }
+  STORE & store = Store();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  auto & values = store.namespaces[m_name];
+  auto found = values.find(key);
+  return found != values.end() ? String(found->second.c_str()) : defaultValue;
+}
+
+void NativePreferences::Clear(){
+  STORE & store = Store();
+  std::lock_guard<std::mutex> lock(store.mutex);
+  store.namespaces.clear();
+}
@@ -0,0 +1,33 @@
+// Preferences for the native test environment. Values are kept in memory for the lifetime of
+// the test program, like NVS keeps them across reboots. NativePreferences::Clear() erases them.
+
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+
+class Preferences {
+public:
+  bool begin(const char * name, bool readOnly = false, const char * partition_label = nullptr);
+  void end();
+
+  bool clear();
+  bool remove(const char * key);
+  bool isKey(const char * key);
+
+  size_t putUInt(const char * key, uint32_t value);
+  uint32_t getUInt(const char * key, uint32_t defaultValue = 0);
+  size_t putString(const char * key, const char * value);
+  size_t putString(const char * key, String value);
+  String getString(const char * key, String defaultValue = String());
+
+private:
+  std::string m_name;
+  bool m_started = false;
+  bool m_read_only = false;
+};
+
+class NativePreferences {
+public:
+  static void Clear();
+};
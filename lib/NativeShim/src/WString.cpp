@@ -0,0 +1,205 @@
+#include "WString.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+  std::string ToBase(unsigned long long value, unsigned char base){
+    if(base < 2 || base > 36){
+      base = 10;
+    }
+    std::string digits;
+    do{
+      const int digit = (int)(value % base);
+      digits += (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+      value /= base;
+    }while(value != 0);
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+  }
+
+  std::string ToBase(long long value, unsigned char base){
+    if(value < 0 && base == 10){
+      return "-" + ToBase((unsigned long long)(-(value + 1)) + 1, base);
+    }
+    return ToBase((unsigned long long)value, base);
+  }
+
+  std::string ToFixed(double value, unsigned int decimalPlaces){
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimalPlaces, value);
+    return buffer;
+  }
+}
+
+String::String(const char * cstr) : m_buffer(cstr != nullptr ? cstr : "") {}
+String::String(const char * cstr, unsigned int length) : m_buffer(cstr != nullptr ? std::string(cstr, length) : std::string()) {}
+String::String(const String & str) : m_buffer(str.m_buffer) {}
+String::String(String && str) : m_buffer(std::move(str.m_buffer)) {}
+String::String(char c) : m_buffer(1, c) {}
+String::String(unsigned char value, unsigned char base) : m_buffer(ToBase((unsigned long long)value, base)) {}
+String::String(int value, unsigned char base) : m_buffer(base == 10 ? ToBase((long long)value, base) : ToBase((unsigned long long)(unsigned int)value, base)) {}
+String::String(unsigned int value, unsigned char base) : m_buffer(ToBase((unsigned long long)value, base)) {}
+String::String(long value, unsigned char base) : m_buffer(ToBase((long long)value, base)) {}
+String::String(unsigned long value, unsigned char base) : m_buffer(ToBase((unsigned long long)value, base)) {}
+String::String(long long value, unsigned char base) : m_buffer(ToBase(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : m_buffer(ToBase(value, base)) {}
+String::String(float value, unsigned int decimalPlaces) : m_buffer(ToFixed(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces) : m_buffer(ToFixed(value, decimalPlaces)) {}
+String::~String() {}
+
+String & String::operator=(const String & rhs){ m_buffer = rhs.m_buffer; return *this; }
+// Like the Arduino core, the buffer of the target is released. std::string would keep its
+// capacity when rhs is short.
+String & String::operator=(String && rhs){ std::string(std::move(rhs.m_buffer)).swap(m_buffer); return *this; }
+String & String::operator=(const char * cstr){ m_buffer = cstr != nullptr ? cstr : ""; return *this; }
+
+bool String::reserve(unsigned int size){ m_buffer.reserve(size); return true; }
+unsigned int String::length() const { return (unsigned int)m_buffer.size(); }
+bool String::isEmpty() const { return m_buffer.empty(); }
+const char * String::c_str() const { return m_buffer.c_str(); }
+
+bool String::concat(const String & str){ m_buffer += str.m_buffer; return true; }
+bool String::concat(const char * cstr){ if(cstr == nullptr){ return false; } m_buffer += cstr; return true; }
+bool String::concat(const char * cstr, unsigned int length){ if(cstr == nullptr){ return false; } m_buffer.append(cstr, length); return true; }
+bool String::concat(char c){ m_buffer += c; return true; }
+bool String::concat(unsigned char value){ return concat(String(value)); }
+bool String::concat(int value){ return concat(String(value)); }
+bool String::concat(unsigned int value){ return concat(String(value)); }
+bool String::concat(long value){ return concat(String(value)); }
+bool String::concat(unsigned long value){ return concat(String(value)); }
+
+String & String::operator+=(const String & rhs){ concat(rhs); return *this; }
+String & String::operator+=(const char * cstr){ concat(cstr); return *this; }
+String & String::operator+=(char c){ concat(c); return *this; }
+String & String::operator+=(unsigned char value){ concat(value); return *this; }
+String & String::operator+=(int value){ concat(value); return *this; }
+String & String::operator+=(unsigned int value){ concat(value); return *this; }
+String & String::operator+=(long value){ concat(value); return *this; }
+String & String::operator+=(unsigned long value){ concat(value); return *this; }
+
+int String::compareTo(const String & s) const { return m_buffer.compare(s.m_buffer); }
+bool String::equals(const String & s) const { return m_buffer == s.m_buffer; }
+bool String::equals(const char * cstr) const { return m_buffer == (cstr != nullptr ? cstr : ""); }
+bool String::equalsIgnoreCase(const String & s) const {
+  if(m_buffer.size() != s.m_buffer.size()){
+    return false;
+  }
+  for(size_t i = 0; i < m_buffer.size(); i++){
+    if(tolower((unsigned char)m_buffer[i]) != tolower((unsigned char)s.m_buffer[i])){
+      return false;
+    }
+  }
+  return true;
+}
+bool String::operator==(const String & rhs) const { return equals(rhs); }
+bool String::operator==(const char * cstr) const { return equals(cstr); }
+bool String::operator!=(const String & rhs) const { return !equals(rhs); }
+bool String::operator!=(const char * cstr) const { return !equals(cstr); }
+bool String::operator<(const String & rhs) const { return m_buffer < rhs.m_buffer; }
+
+bool String::startsWith(const String & prefix) const { return startsWith(prefix, 0); }
+bool String::startsWith(const String & prefix, unsigned int offset) const {
+  return offset <= m_buffer.size() && m_buffer.compare(offset, prefix.m_buffer.size(), prefix.m_buffer) == 0;
+}
+bool String::endsWith(const String & suffix) const {
+  return suffix.m_buffer.size() <= m_buffer.size() && m_buffer.compare(m_buffer.size() - suffix.m_buffer.size(), suffix.m_buffer.size(), suffix.m_buffer) == 0;
+}
+
+char String::charAt(unsigned int index) const { return index < m_buffer.size() ? m_buffer[index] : '\0'; }
+char String::operator[](unsigned int index) const { return charAt(index); }
+char & String::operator[](unsigned int index){
+  static char dummy;
+  if(index >= m_buffer.size()){
+    dummy = '\0';
+    return dummy;
+  }
+  return m_buffer[index];
+}
+
+int String::indexOf(char ch) const { return indexOf(ch, 0); }
+int String::indexOf(char ch, unsigned int fromIndex) const {
+  const size_t found = m_buffer.find(ch, fromIndex);
+  return found == std::string::npos ? -1 : (int)found;
+}
+int String::indexOf(const String & str) const { return indexOf(str, 0); }
+int String::indexOf(const String & str, unsigned int fromIndex) const {
+  const size_t found = m_buffer.find(str.m_buffer, fromIndex);
+  return found == std::string::npos ? -1 : (int)found;
+}
+int String::lastIndexOf(char ch) const {
+  const size_t found = m_buffer.rfind(ch);
+  return found == std::string::npos ? -1 : (int)found;
+}
+int String::lastIndexOf(const String & str) const {
+  const size_t found = m_buffer.rfind(str.m_buffer);
+  return found == std::string::npos ? -1 : (int)found;
+}
+
+String String::substring(unsigned int beginIndex) const { return substring(beginIndex, length()); }
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+  if(beginIndex > endIndex){
+    std::swap(beginIndex, endIndex);
+  }
+  if(beginIndex >= m_buffer.size()){
+    return String();
+  }
+  endIndex = std::min<unsigned int>(endIndex, length());
+  const std::string part = m_buffer.substr(beginIndex, endIndex - beginIndex);
+  return String(part.c_str(), (unsigned int)part.size());
+}
+
+void String::replace(const String & find, const String & replace){
+  if(find.m_buffer.empty()){
+    return;
+  }
+  size_t pos = 0;
+  while((pos = m_buffer.find(find.m_buffer, pos)) != std::string::npos){
+    m_buffer.replace(pos, find.m_buffer.size(), replace.m_buffer);
+    pos += replace.m_buffer.size();
+  }
+}
+void String::remove(unsigned int index){ remove(index, (unsigned int)-1); }
+void String::remove(unsigned int index, unsigned int count){
+  if(index >= m_buffer.size()){
+    return;
+  }
+  m_buffer.erase(index, count);
+}
+void String::toLowerCase(){ for(auto & c : m_buffer){ c = (char)tolower((unsigned char)c); } }
+void String::toUpperCase(){ for(auto & c : m_buffer){ c = (char)toupper((unsigned char)c); } }
+void String::trim(){
+  const size_t begin = m_buffer.find_first_not_of(" \t\r\n\f\v");
+  if(begin == std::string::npos){
+    m_buffer.clear();
+    return;
+  }
+  const size_t end = m_buffer.find_last_not_of(" \t\r\n\f\v");
+  m_buffer = m_buffer.substr(begin, end - begin + 1);
+}
+
+long String::toInt() const { return atol(m_buffer.c_str()); }
+float String::toFloat() const { return (float)atof(m_buffer.c_str()); }
+
+StringSumHelper operator+(const String & lhs, const String & rhs){
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+StringSumHelper operator+(const String & lhs, const char * rhs){
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+StringSumHelper operator+(const char * lhs, const String & rhs){
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+StringSumHelper operator+(const String & lhs, char rhs){
+  StringSumHelper sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
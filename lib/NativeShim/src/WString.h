@@ -0,0 +1,108 @@
+// String class of the Arduino core for the native test environment.
+// It keeps the Arduino API used by src/ and by ArduinoJson on top of std::string.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class StringSumHelper;
+
+class String {
+public:
+  String(const char * cstr = "");
+  String(const char * cstr, unsigned int length);
+  String(const String & str);
+  String(String && str);
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned int decimalPlaces = 2);
+  explicit String(double value, unsigned int decimalPlaces = 2);
+  ~String();
+
+  String & operator=(const String & rhs);
+  String & operator=(String && rhs);
+  String & operator=(const char * cstr);
+
+  bool reserve(unsigned int size);
+  unsigned int length() const;
+  bool isEmpty() const;
+  const char * c_str() const;
+
+  bool concat(const String & str);
+  bool concat(const char * cstr);
+  bool concat(const char * cstr, unsigned int length);
+  bool concat(char c);
+  bool concat(unsigned char value);
+  bool concat(int value);
+  bool concat(unsigned int value);
+  bool concat(long value);
+  bool concat(unsigned long value);
+
+  String & operator+=(const String & rhs);
+  String & operator+=(const char * cstr);
+  String & operator+=(char c);
+  String & operator+=(unsigned char value);
+  String & operator+=(int value);
+  String & operator+=(unsigned int value);
+  String & operator+=(long value);
+  String & operator+=(unsigned long value);
+
+  int compareTo(const String & s) const;
+  bool equals(const String & s) const;
+  bool equals(const char * cstr) const;
+  bool equalsIgnoreCase(const String & s) const;
+  bool operator==(const String & rhs) const;
+  bool operator==(const char * cstr) const;
+  bool operator!=(const String & rhs) const;
+  bool operator!=(const char * cstr) const;
+  bool operator<(const String & rhs) const;
+
+  bool startsWith(const String & prefix) const;
+  bool startsWith(const String & prefix, unsigned int offset) const;
+  bool endsWith(const String & suffix) const;
+
+  char charAt(unsigned int index) const;
+  char operator[](unsigned int index) const;
+  char & operator[](unsigned int index);
+
+  int indexOf(char ch) const;
+  int indexOf(char ch, unsigned int fromIndex) const;
+  int indexOf(const String & str) const;
+  int indexOf(const String & str, unsigned int fromIndex) const;
+  int lastIndexOf(char ch) const;
+  int lastIndexOf(const String & str) const;
+
+  String substring(unsigned int beginIndex) const;
+  String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+  void replace(const String & find, const String & replace);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const;
+  float toFloat() const;
+
+private:
+  std::string m_buffer;
+};
+
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String & s) : String(s) {}
+  StringSumHelper(const char * p) : String(p) {}
+};
+
+StringSumHelper operator+(const String & lhs, const String & rhs);
+StringSumHelper operator+(const String & lhs, const char * rhs);
+StringSumHelper operator+(const char * lhs, const String & rhs);
+StringSumHelper operator+(const String & lhs, char rhs);
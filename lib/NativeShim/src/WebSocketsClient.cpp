@@ -0,0 +1,113 @@
+#include "WebSocketsClient.h"
+#include <vector>
+
+WebSocketsClient::WebSocketsClient(){
+}
+
+WebSocketsClient::~WebSocketsClient(){
+  if(m_connection){
+    m_connection->Stop();
+  }
+}
+
+void WebSocketsClient::begin(IPAddress host, uint16_t port, const char * url, const char * protocol){
+  (void)protocol;
+  m_host = host;
+  m_port = port;
+  m_url = url;
+  m_begun = true;
+  m_last_fail_ms = 0;
+}
+
+void WebSocketsClient::onEvent(WebSocketClientEvent cbEvent){
+  m_event = cbEvent;
+}
+
+void WebSocketsClient::setReconnectInterval(unsigned long time){
+  m_reconnect_interval_ms = time;
+}
+
+void WebSocketsClient::enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount){
+  m_ping_interval_ms = pingInterval;
+  m_pong_timeout_ms = pongTimeout;
+  m_disconnect_count = disconnectTimeoutCount;
+}
+
+void WebSocketsClient::RunEvent(WStype_t type, const std::string & payload){
+  if(!m_event){
+    return;
+  }
+  // The callback gets a writable, NUL terminated copy like the library passes its buffer.
+  std::vector<uint8_t> buffer(payload.begin(), payload.end());
+  buffer.push_back('\0');
+  m_event(type, buffer.data(), payload.size());
+}
+
+void WebSocketsClient::Close(){
+  if(!m_connection){
+    return;
+  }
+  m_connection->Stop();
+  m_connection.reset();
+  m_last_fail_ms = millis();
+  RunEvent(WStype_DISCONNECTED, std::string());
+}
+
+void WebSocketsClient::loop(){
+  if(!m_begun){
+    return;
+  }
+
+  if(!m_connection){
+    if(m_last_fail_ms != 0 && millis() - m_last_fail_ms < m_reconnect_interval_ms){
+      return;
+    }
+    m_connection = NativeNetwork::Connect(m_host, m_port);
+    if(!m_connection){
+      m_last_fail_ms = millis();
+      return;
+    }
+    m_last_pong_ms = millis();
+    RunEvent(WStype_CONNECTED, m_url);
+    return;
+  }
+
+  if(!m_connection->IsOpen() && !m_connection->HasPendingData()){
+    Close();
+    return;
+  }
+
+  if(m_ping_interval_ms != 0){
+    if(m_connection->GetServer()->AnswersPing()){
+      m_last_pong_ms = millis();
+    }else if(millis() - m_last_pong_ms > m_ping_interval_ms + m_pong_timeout_ms * m_disconnect_count){
+      Close();
+      return;
+    }
+  }
+
+  std::string frame;
+  while(m_connection && m_connection->PopFrame(frame)){
+    RunEvent(WStype_TEXT, frame);
+  }
+}
+
+bool WebSocketsClient::sendTXT(String & payload){
+  return sendTXT(payload.c_str());
+}
+
+bool WebSocketsClient::sendTXT(const char * payload){
+  if(!m_connection || !m_connection->IsOpen()){
+    return false;
+  }
+  m_connection->Write(payload);
+  return true;
+}
+
+bool WebSocketsClient::isConnected(){
+  return m_connection && m_connection->IsOpen();
+}
+
+void WebSocketsClient::disconnect(){
+  Close();
+}
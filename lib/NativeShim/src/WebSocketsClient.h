@@ -0,0 +1,62 @@
+// WebSocketsClient for the native test environment. It keeps the API of links2004/WebSockets
+// used by LgtvControl and connects to servers registered in NativeNetwork.
+// Text frames sent by a server are passed to the event callback from loop(), as on the device.
+// A server that does not answer pings is disconnected after the heartbeat timeout.
+
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include "NativeNetwork.h"
+
+typedef enum {
+  WStype_ERROR,
+  WStype_DISCONNECTED,
+  WStype_CONNECTED,
+  WStype_TEXT,
+  WStype_BIN,
+  WStype_FRAGMENT_TEXT_START,
+  WStype_FRAGMENT_BIN_START,
+  WStype_FRAGMENT,
+  WStype_FRAGMENT_FIN,
+  WStype_PING,
+  WStype_PONG
+} WStype_t;
+
+class WebSocketsClient {
+public:
+  typedef std::function<void(WStype_t type, uint8_t * payload, size_t length)> WebSocketClientEvent;
+
+  WebSocketsClient();
+  ~WebSocketsClient();
+
+  void begin(IPAddress host, uint16_t port, const char * url = "/", const char * protocol = "arduino");
+  void onEvent(WebSocketClientEvent cbEvent);
+  void setReconnectInterval(unsigned long time);
+  void enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount);
+
+  void loop();
+
+  bool sendTXT(String & payload);
+  bool sendTXT(const char * payload);
+  bool isConnected();
+  void disconnect();
+
+private:
+  void RunEvent(WStype_t type, const std::string & payload);
+  void Close();
+
+  bool m_begun = false;
+  IPAddress m_host;
+  uint16_t m_port = 0;
+  std::string m_url = "/";
+  WebSocketClientEvent m_event = nullptr;
+  unsigned long m_reconnect_interval_ms = 500;
+  uint32_t m_last_fail_ms = 0;
+  uint32_t m_ping_interval_ms = 0;
+  uint32_t m_pong_timeout_ms = 0;
+  uint8_t m_disconnect_count = 0;
+  uint32_t m_last_pong_ms = 0;
+  std::shared_ptr<NativeConnection> m_connection;
+};
@@ -0,0 +1,79 @@
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::status(){
+  return NativeNetwork::GetWiFiStatus();
+}
+
+WiFiClient::WiFiClient(){
+}
+
+WiFiClient::~WiFiClient(){
+  stop();
+}
+
+std::shared_ptr<NativeConnection> WiFiClient::Connection() const {
+  return std::atomic_load(&m_connection);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port){
+  stop();
+  auto connection = NativeNetwork::Connect(ip, port);
+  std::atomic_store(&m_connection, connection);
+  return connection ? 1 : 0;
+}
+
+uint8_t WiFiClient::connected(){
+  auto connection = Connection();
+  if(!connection){
+    return 0;
+  }
+  return connection->IsOpen() || connection->Available() > 0 ? 1 : 0;
+}
+
+int WiFiClient::available(){
+  auto connection = Connection();
+  return connection ? (int)connection->Available() : 0;
+}
+
+int WiFiClient::read(){
+  auto connection = Connection();
+  return connection ? connection->Read() : -1;
+}
+
+size_t WiFiClient::write(const uint8_t * buffer, size_t size){
+  auto connection = Connection();
+  if(!connection || !connection->IsOpen()){
+    return 0;
+  }
+  connection->Write(std::string((const char *)buffer, size));
+  return size;
+}
+
+size_t WiFiClient::print(const String & str){
+  return write((const uint8_t *)str.c_str(), str.length());
+}
+
+size_t WiFiClient::print(const char * str){
+  return write((const uint8_t *)str, strlen(str));
+}
+
+int WiFiClient::setNoDelay(bool nodelay){
+  auto connection = Connection();
+  if(!connection){
+    return 0;
+  }
+  connection->SetNoDelay(nodelay);
+  return 1;
+}
+
+void WiFiClient::flush(){
+}
+
+void WiFiClient::stop(){
+  auto connection = std::atomic_exchange(&m_connection, std::shared_ptr<NativeConnection>());
+  if(connection){
+    connection->Stop();
+  }
+}
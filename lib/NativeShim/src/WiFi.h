@@ -0,0 +1,40 @@
+// WiFi.h for the native test environment. WiFiClient connects to servers registered in
+// NativeNetwork, and WiFi.status() returns the status set by NativeNetwork::SetWiFiStatus().
+
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include "NativeNetwork.h"
+
+class WiFiClient {
+public:
+  WiFiClient();
+  ~WiFiClient();
+
+  /// @return 1 if connected, 0 if not.
+  int connect(IPAddress ip, uint16_t port);
+  uint8_t connected();
+  int available();
+  int read();
+  size_t write(const uint8_t * buffer, size_t size);
+  size_t print(const String & str);
+  size_t print(const char * str);
+  int setNoDelay(bool nodelay);
+  void flush();
+  void stop();
+
+private:
+  std::shared_ptr<NativeConnection> Connection() const;
+
+  // WiFiClient is shared by CommandHandler and the caller of IsConnected(), so the pointer is
+  // read and replaced atomically.
+  std::shared_ptr<NativeConnection> m_connection;
+};
+
+class WiFiClass {
+public:
+  wl_status_t status();
+};
+
+extern WiFiClass WiFi;
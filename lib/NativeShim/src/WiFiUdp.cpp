@@ -0,0 +1,104 @@
+#include "WiFiUdp.h"
+#include <algorithm>
+#include "NativeScheduler.h"
+
+WiFiUDP::WiFiUDP(){
+}
+
+WiFiUDP::~WiFiUDP(){
+}
+
+uint8_t WiFiUDP::begin(uint16_t port){
+  (void)port;
+  m_open = NativeNetwork::GetWiFiStatus() == WL_CONNECTED;
+  return m_open ? 1 : 0;
+}
+
+void WiFiUDP::stop(){
+  m_open = false;
+  m_in.clear();
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port){
+  m_to = ip;
+  m_to_port = port;
+  m_out.clear();
+  return 1;
+}
+
+size_t WiFiUDP::write(uint8_t data){
+  m_out += (char)data;
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t * buffer, size_t size){
+  m_out.append((const char *)buffer, size);
+  return size;
+}
+
+size_t WiFiUDP::printf(const char * format, ...){
+  char buffer[1024];
+  va_list args;
+  va_start(args, format);
+  const int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if(length <= 0){
+    return 0;
+  }
+  return write((const uint8_t *)buffer, std::min((size_t)length, sizeof(buffer) - 1));
+}
+
+int WiFiUDP::endPacket(){
+  if(!m_open){
+    return 0;
+  }
+  std::vector<NativeNetwork::UDP_REPLY> replies;
+  NativeNetwork::SendUdp(m_to, m_to_port, m_out, replies);
+  const uint64_t now_us = NativeScheduler::NowMicros();
+  for(const auto & reply : replies){
+    m_in.push_back(PACKET{ now_us + (uint64_t)reply.delay_ms * 1000, reply.from, reply.port, reply.data });
+  }
+  std::stable_sort(m_in.begin(), m_in.end(), [](const PACKET & a, const PACKET & b){ return a.due_us < b.due_us; });
+  m_out.clear();
+  return 1;
+}
+
+int WiFiUDP::parsePacket(){
+  if(m_in.empty() || m_in.front().due_us > NativeScheduler::NowMicros()){
+    return 0;
+  }
+  m_current = m_in.front();
+  m_in.pop_front();
+  m_offset = 0;
+  return (int)m_current.data.size();
+}
+
+int WiFiUDP::available(){
+  return (int)(m_current.data.size() - m_offset);
+}
+
+int WiFiUDP::read(){
+  if(m_offset >= m_current.data.size()){
+    return -1;
+  }
+  return (uint8_t)m_current.data[m_offset++];
+}
+
+int WiFiUDP::read(unsigned char * buffer, size_t len){
+  const size_t length = std::min(len, m_current.data.size() - m_offset);
+  memcpy(buffer, m_current.data.data() + m_offset, length);
+  m_offset += length;
+  return (int)length;
+}
+
+int WiFiUDP::read(char * buffer, size_t len){
+  return read((unsigned char *)buffer, len);
+}
+
+IPAddress WiFiUDP::remoteIP(){
+  return m_current.from;
+}
+
+uint16_t WiFiUDP::remotePort(){
+  return m_current.port;
+}
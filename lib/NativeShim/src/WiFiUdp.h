@@ -0,0 +1,49 @@
+// WiFiUdp.h for the native test environment. Datagrams are passed to the UDP responders of
+// NativeNetwork, and their replies are read back by parsePacket() and read().
+
+#pragma once
+
+#include <Arduino.h>
+#include <deque>
+#include <string>
+#include "NativeNetwork.h"
+
+class WiFiUDP {
+public:
+  WiFiUDP();
+  ~WiFiUDP();
+
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t * buffer, size_t size);
+  size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3)));
+  int endPacket();
+
+  /// @return size of the next datagram that arrived, 0 if none.
+  int parsePacket();
+  int available();
+  int read();
+  int read(unsigned char * buffer, size_t len);
+  int read(char * buffer, size_t len);
+  IPAddress remoteIP();
+  uint16_t remotePort();
+
+private:
+  struct PACKET {
+    uint64_t due_us;
+    IPAddress from;
+    uint16_t port;
+    std::string data;
+  };
+
+  bool m_open = false;
+  IPAddress m_to;
+  uint16_t m_to_port = 0;
+  std::string m_out;
+  std::deque<PACKET> m_in;
+  PACKET m_current;
+  size_t m_offset = 0;
+};
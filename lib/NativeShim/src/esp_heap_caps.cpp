@@ -0,0 +1,29 @@
+#include "esp_heap_caps.h"
+#include "NativeHeap.h"
+
+void heap_caps_get_info(multi_heap_info_t * info, uint32_t caps){
+  (void)caps;
+  const NativeHeap::STATS stats = NativeHeap::GetStats();
+  info->total_free_bytes      = stats.free;
+  info->total_allocated_bytes = stats.in_use;
+  info->largest_free_block    = stats.largest_free_block;
+  info->minimum_free_bytes    = stats.minimum_free;
+  info->allocated_blocks      = stats.live_blocks;
+  info->free_blocks           = stats.free_blocks;
+  info->total_blocks          = stats.live_blocks + stats.free_blocks;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps){
+  (void)caps;
+  return NativeHeap::GetStats().free;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps){
+  (void)caps;
+  return NativeHeap::GetStats().largest_free_block;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps){
+  (void)caps;
+  return NativeHeap::GetStats().minimum_free;
+}
@@ -0,0 +1,23 @@
+// FreeRTOS types for the native test environment. Tasks and semaphores are implemented
+// by NativeScheduler.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef int32_t  BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef struct NativeTask * TaskHandle_t;
+typedef struct NativeSemaphore * SemaphoreHandle_t;
+
+#define pdFALSE            ((BaseType_t)0)
+#define pdTRUE             ((BaseType_t)1)
+#define pdFAIL             pdFALSE
+#define pdPASS             pdTRUE
+#define portMAX_DELAY      ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define tskNO_AFFINITY     ((BaseType_t)0x7FFFFFFF)
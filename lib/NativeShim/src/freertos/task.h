@@ -0,0 +1,18 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+/// usStackDepth is in bytes as on ESP-IDF. The host stack is larger because host frames are.
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char * pcName, uint32_t usStackDepth,
+                                   void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pvCreatedTask,
+                                   BaseType_t xCoreID);
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char * pcName, uint32_t usStackDepth,
+                       void * pvParameters, UBaseType_t uxPriority, TaskHandle_t * pvCreatedTask);
+
+/// Only the calling task can be deleted. Pass NULL.
+void vTaskDelete(TaskHandle_t xTask);
+void vTaskDelay(TickType_t xTicksToDelay);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+/// @return free stack bytes that were never used by the calling task. 0 for the main thread.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask);
@@ -0,0 +1,30 @@
+#include "Backoff.h"
+
+Backoff::Backoff(uint32_t min_ms, uint32_t max_ms) : m_min_ms(min_ms), m_max_ms(max_ms){
+}
+
+Backoff::~Backoff(){
+}
+
+uint32_t Backoff::Next(){
+  if(m_attempt == 0){
+    m_attempt++;
+    return 0;
+  }
+
+  uint32_t delay_ms = m_min_ms;
+  for(uint32_t i = 1; i < m_attempt && delay_ms < m_max_ms; i++){
+    delay_ms *= 2;
+  }
+  if(delay_ms > m_max_ms){
+    delay_ms = m_max_ms;
+  }
+  m_attempt++;
+
+  const uint32_t half = delay_ms / 2;
+  return half + random(half + 1);
+}
+
+void Backoff::Reset(){
+  m_attempt = 0;
+}
@@ -0,0 +1,34 @@
+// Backoff class computes reconnect delays with jittered exponential backoff.
+//
+// Usage:
+// 1. Create an Instance
+//   Backoff bo(250, 30000);
+// 2. Wait before each attempt
+//   delay(bo.Next());
+// 3. Reset after success
+//   bo.Reset();
+//
+// Note:
+// The first delay after Reset() is 0 so that the first reconnect is immediate.
+// Later delays double from min_ms up to max_ms. Each delay is picked at random
+// from the upper half of its range so that clients do not retry in lockstep.
+
+#pragma once
+
+#include <Arduino.h>
+
+class Backoff {
+public:
+  Backoff(uint32_t min_ms, uint32_t max_ms);
+  ~Backoff();
+
+  /// @return delay before the next attempt in milliseconds.
+  uint32_t Next();
+
+  void Reset();
+
+private:
+  const uint32_t m_min_ms;
+  const uint32_t m_max_ms;
+  uint32_t m_attempt = 0;
+};
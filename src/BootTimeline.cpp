@@ -0,0 +1,51 @@
+#include <unordered_map>
+#include "BootTimeline.h"
+
+namespace {
+  const std::unordered_map<BootTimeline::STAGE, String> STAGE_LIST = {
+    { BootTimeline::STAGE::ButtonsArmed,  String("ButtonsArmed")  },
+    { BootTimeline::STAGE::WifiConnected, String("WifiConnected") },
+    { BootTimeline::STAGE::HeosReady,     String("HeosReady")     },
+    { BootTimeline::STAGE::LgtvReady,     String("LgtvReady")     },
+    { BootTimeline::STAGE::FirstCommand,  String("FirstCommand")  },
+    { BootTimeline::STAGE::FirstResponse, String("FirstResponse") }
+  };
+
+  String GetStageName(BootTimeline::STAGE stage){
+    return STAGE_LIST.count(stage) > 0 ? STAGE_LIST.at(stage) : String();
+  }
+}
+
+BootTimeline::BootTimeline(){
+}
+
+BootTimeline::~BootTimeline(){
+}
+
+bool BootTimeline::Mark(STAGE stage){
+  if(stage == STAGE::Invalid || m_time_us[(int)stage] != 0){
+    return false;
+  }
+  // micros() is never 0 after the scheduler starts, so 0 can mean "not reached".
+  m_time_us[(int)stage] = micros();
+  return true;
+}
+
+uint32_t BootTimeline::GetTime(STAGE stage){
+  if(stage == STAGE::Invalid){
+    return 0;
+  }
+  return m_time_us[(int)stage];
+}
+
+void BootTimeline::Print(){
+  Serial.printf("(BOOT)Timeline\r\n");
+  for(int i = 0; i < STAGE_COUNT; i++){
+    const STAGE stage = (STAGE)i;
+    if(m_time_us[i] == 0){
+      Serial.printf("(BOOT)  %-14s : -\r\n", GetStageName(stage).c_str());
+    }else{
+      Serial.printf("(BOOT)  %-14s : %lu us\r\n", GetStageName(stage).c_str(), (unsigned long)m_time_us[i]);
+    }
+  }
+}
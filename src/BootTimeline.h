@@ -0,0 +1,47 @@
+// BootTimeline class records when each boot stage is reached.
+//
+// Usage:
+// 1. Create an Instance
+//   BootTimeline bt;
+// 2. Mark stages
+//   bt.Mark(BootTimeline::STAGE::WifiConnected);
+// 3. Read back
+//   bt.GetTime(BootTimeline::STAGE::WifiConnected);
+//   bt.Print();
+//
+// Note:
+// Times are microseconds since power-on. Only the first Mark() of each stage is recorded.
+// FirstCommand is when the first command is queued. FirstResponse is when a device confirms it.
+// Mark() may be called from any task.
+
+#pragma once
+
+#include <Arduino.h>
+
+class BootTimeline {
+public:
+  enum class STAGE {
+    ButtonsArmed,
+    WifiConnected,
+    HeosReady,
+    LgtvReady,
+    FirstCommand,
+    FirstResponse,
+    Invalid
+  };
+
+  BootTimeline();
+  ~BootTimeline();
+
+  /// @return false if the stage was already recorded.
+  bool Mark(STAGE stage);
+
+  /// @return microseconds since power-on. 0 if the stage is not reached yet.
+  uint32_t GetTime(STAGE stage);
+
+  void Print();
+
+private:
+  static const int STAGE_COUNT = (int)STAGE::Invalid;
+  volatile uint32_t m_time_us[STAGE_COUNT] = {};
+};
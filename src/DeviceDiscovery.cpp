@@ -0,0 +1,233 @@
+#include <strings.h>
+#include <unordered_map>
+#include "DeviceDiscovery.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+namespace {
+  const IPAddress SSDP_MULTICAST(239,255,255,250);
+
+  const std::unordered_map<DeviceDiscovery::DEVICE, String> SEARCH_TARGET_LIST = {
+    { DeviceDiscovery::DEVICE::Heos, String("urn:schemas-denon-com:device:ACT-Denon:1") },
+    { DeviceDiscovery::DEVICE::Lgtv, String("urn:lge-com:service:webos-second-screen:1") }
+  };
+
+  const std::unordered_map<DeviceDiscovery::DEVICE, String> PREFERENCE_KEY_LIST = {
+    { DeviceDiscovery::DEVICE::Heos, String("heos") },
+    { DeviceDiscovery::DEVICE::Lgtv, String("lgtv") }
+  };
+
+  String GetSearchTarget(DeviceDiscovery::DEVICE device){
+    return SEARCH_TARGET_LIST.count(device) > 0 ? SEARCH_TARGET_LIST.at(device) : String();
+  }
+
+  String GetPreferenceKey(DeviceDiscovery::DEVICE device){
+    return PREFERENCE_KEY_LIST.count(device) > 0 ? PREFERENCE_KEY_LIST.at(device) : String();
+  }
+
+  String GetUuidPreferenceKey(DeviceDiscovery::DEVICE device){
+    return GetPreferenceKey(device) + String("_usn");
+  }
+
+  // ParseUuid returns the UUID in the USN header of an SSDP response.
+  // "USN: uuid:5f9ec1b3-...::urn:..." gives "5f9ec1b3-...". Header names are case-insensitive.
+  String ParseUuid(const char * response){
+    const char * line = response;
+    while(line != nullptr){
+      if(strncasecmp(line, "USN:", 4) == 0){
+        const char * value = line + 4;
+        while(*value == ' '){
+          value++;
+        }
+        if(strncasecmp(value, "uuid:", 5) == 0){
+          value += 5;
+        }
+        size_t length = 0;
+        while(value[length] != '\0' && value[length] != '\r' && value[length] != '\n' && strncmp(value + length, "::", 2) != 0){
+          length++;
+        }
+        return String(value).substring(0, length);
+      }
+      line = strchr(line, '\n');
+      if(line != nullptr){
+        line++;
+      }
+    }
+    return String();
+  }
+}
+
+DeviceDiscovery::DeviceDiscovery(){
+  m_mutex = xSemaphoreCreateMutex();
+  m_request_mutex = xSemaphoreCreateMutex();
+}
+
+DeviceDiscovery::~DeviceDiscovery(){
+  m_prefs.end();
+  vSemaphoreDelete(m_mutex);
+  vSemaphoreDelete(m_request_mutex);
+}
+
+void DeviceDiscovery::Begin(){
+  m_prefs.begin("discovery", false);
+  for(int i = 0; i < DEVICE_COUNT; i++){
+    m_address[i] = m_prefs.getUInt(GetPreferenceKey((DEVICE)i).c_str(), 0);
+    m_uuid[i] = m_prefs.getString(GetUuidPreferenceKey((DEVICE)i).c_str());
+    if(m_address[i] != 0){
+      Serial.printf("(SSDP)Cached %s: %s %s\r\n", GetPreferenceKey((DEVICE)i).c_str(), IPAddress(m_address[i]).toString().c_str(), m_uuid[i].c_str());
+    }
+  }
+}
+
+IPAddress DeviceDiscovery::GetAddress(DEVICE device){
+  if(device == DEVICE::Invalid){
+    return IPAddress();
+  }
+  return IPAddress(m_address[(int)device]);
+}
+
+String DeviceDiscovery::GetUuid(DEVICE device){
+  if(device == DEVICE::Invalid){
+    return String();
+  }
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+  const String uuid = m_uuid[(int)device];
+  xSemaphoreGive(m_mutex);
+  return uuid;
+}
+
+bool DeviceDiscovery::Discover(DEVICE device, uint32_t timeout_ms){
+  const String st = GetSearchTarget(device);
+  if(st.isEmpty()){
+    return false;
+  }
+
+  xSemaphoreTake(m_mutex, portMAX_DELAY);
+
+  WiFiUDP udp;
+  if(!udp.begin(0)){
+    Serial.printf("(SSDP)Cannot open socket\r\n");
+    xSemaphoreGive(m_mutex);
+    return false;
+  }
+
+  // M-SEARCH is sent twice because UDP may be lost.
+  const uint32_t start_ms = millis();
+  bool resent = false;
+  bool found = false;
+
+  // Another device of the same kind may answer first. The one found before is waited for until
+  // timeout, and the first other one is taken only if it does not answer.
+  const String known_uuid = m_uuid[(int)device];
+  IPAddress other_address;
+  String other_uuid;
+  SendSearch(udp, st.c_str());
+
+  char buffer[512];
+  while(millis() - start_ms < timeout_ms){
+    if(!resent && millis() - start_ms > timeout_ms / 2){
+      SendSearch(udp, st.c_str());
+      resent = true;
+    }
+
+    if(udp.parsePacket() <= 0){
+      delay(10);
+      continue;
+    }
+
+    const int length = udp.read(buffer, sizeof(buffer) - 1);
+    if(length <= 0){
+      continue;
+    }
+    buffer[length] = '\0';
+
+    // Other devices answer M-SEARCH too. Only responses for st are taken.
+    if(strstr(buffer, st.c_str()) == nullptr){
+      continue;
+    }
+
+    const IPAddress address = udp.remoteIP();
+    const String uuid = ParseUuid(buffer);
+    if(!known_uuid.isEmpty() && uuid != known_uuid){
+      if((uint32_t)other_address == 0){
+        other_address = address;
+        other_uuid = uuid;
+      }
+      continue;
+    }
+
+    Serial.printf("(SSDP)Found %s: %s in %lu ms\r\n", GetPreferenceKey(device).c_str(), address.toString().c_str(), (unsigned long)(millis() - start_ms));
+    SetDevice(device, address, uuid);
+    found = true;
+    break;
+  }
+
+  if(!found && (uint32_t)other_address != 0){
+    Serial.printf("(SSDP)Known %s not found. Taking %s\r\n", GetPreferenceKey(device).c_str(), other_address.toString().c_str());
+    SetDevice(device, other_address, other_uuid);
+    found = true;
+  }
+
+  udp.stop();
+  xSemaphoreGive(m_mutex);
+
+  if(!found){
+    Serial.printf("(SSDP)%s not found\r\n", GetPreferenceKey(device).c_str());
+  }
+  return found;
+}
+
+void DeviceDiscoveryTaskThread(void * request){
+  DeviceDiscovery::REQUEST * req = (DeviceDiscovery::REQUEST *)request;
+  const bool found = req->self->Discover(req->device, req->timeout_ms);
+  req->self->m_discovering[(int)req->device] = false;
+  req->result_callback(found ? req->self->GetAddress(req->device) : IPAddress());
+  delete req;
+  vTaskDelete(NULL);
+}
+
+bool DeviceDiscovery::DiscoverAsync(DEVICE device, std::function<void(IPAddress)> result_callback, uint32_t timeout_ms){
+  if(device == DEVICE::Invalid || !result_callback){
+    return false;
+  }
+
+  xSemaphoreTake(m_request_mutex, portMAX_DELAY);
+  const bool discovering = m_discovering[(int)device];
+  m_discovering[(int)device] = true;
+  xSemaphoreGive(m_request_mutex);
+  if(discovering){
+    return false;
+  }
+
+  REQUEST * request = new REQUEST{ this, device, timeout_ms, result_callback };
+  if(xTaskCreatePinnedToCore(DeviceDiscoveryTaskThread, "DeviceDiscovery", 4096, request, 1, nullptr, 0) != pdPASS){
+    Serial.printf("(SSDP)Cannot create task\r\n");
+    m_discovering[(int)device] = false;
+    delete request;
+    return false;
+  }
+  return true;
+}
+
+void DeviceDiscovery::SendSearch(WiFiUDP & udp, const char * st){
+  udp.beginPacket(SSDP_MULTICAST, ssdpport);
+  udp.printf("M-SEARCH * HTTP/1.1\r\n"
+             "HOST: 239.255.255.250:1900\r\n"
+             "MAN: \"ssdp:discover\"\r\n"
+             "MX: 1\r\n"
+             "ST: %s\r\n"
+             "\r\n", st);
+  udp.endPacket();
+}
+
+void DeviceDiscovery::SetDevice(DEVICE device, IPAddress address, const String & uuid){
+  const uint32_t value = (uint32_t)address;
+  if(m_address[(int)device] != value){
+    m_address[(int)device] = value;
+    m_prefs.putUInt(GetPreferenceKey(device).c_str(), value);
+  }
+  if(m_uuid[(int)device] != uuid){
+    m_uuid[(int)device] = uuid;
+    m_prefs.putString(GetUuidPreferenceKey(device).c_str(), uuid);
+  }
+}
@@ -0,0 +1,78 @@
+// DeviceDiscovery class finds HEOS devices and LG TVs by SSDP and keeps their addresses.
+//
+// Usage:
+// 1. Create an Instance
+//   DeviceDiscovery dd;
+// 2. Load cached addresses from non-volatile memory
+//   dd.Begin();
+// 3. Use the cached address first
+//   IPAddress heosdevice = dd.GetAddress(DeviceDiscovery::DEVICE::Heos);
+// 4. Discover again only when connecting to the cached address fails
+//   dd.Discover(DeviceDiscovery::DEVICE::Heos);
+//   or without blocking the caller
+//   dd.DiscoverAsync(DeviceDiscovery::DEVICE::Heos, [](IPAddress address){ ... });
+//
+// Note:
+// Discover() blocks the calling task for up to timeout_ms. Call it from a background task.
+// It returns as soon as the device answers. Found addresses are stored into non-volatile memory
+// together with the UUID from the USN header. Once a UUID is known, that device is preferred over
+// other devices of the same kind.
+// One scan runs at a time. A second caller waits for the first one.
+// DiscoverAsync() runs Discover() in its own task and passes the result to result_callback
+// from that task. A request for a device that is already being discovered is ignored.
+
+#pragma once
+
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <Preferences.h>
+#include <functional>
+
+class DeviceDiscovery {
+public:
+  enum class DEVICE {
+    Heos,
+    Lgtv,
+    Invalid
+  };
+
+  DeviceDiscovery();
+  ~DeviceDiscovery();
+
+  void Begin();
+
+  /// @return cached address. 0.0.0.0 if not known.
+  IPAddress GetAddress(DEVICE device);
+
+  /// @return UUID of the device found last. Empty if not known. It waits for a running scan.
+  String GetUuid(DEVICE device);
+
+  /// @return true if the device answered within timeout_ms.
+  bool Discover(DEVICE device, uint32_t timeout_ms = 3000);
+
+  /// @param result_callback is called with the address found, or 0.0.0.0 if not found.
+  /// @return false if discovery of device is already running or the task cannot be created.
+  bool DiscoverAsync(DEVICE device, std::function<void(IPAddress)> result_callback, uint32_t timeout_ms = 3000);
+
+private:
+  void SendSearch(WiFiUDP & udp, const char * st);
+  void SetDevice(DEVICE device, IPAddress address, const String & uuid);
+
+  struct REQUEST {
+    DeviceDiscovery * self;
+    DEVICE device;
+    uint32_t timeout_ms;
+    std::function<void(IPAddress)> result_callback;
+  };
+  friend void DeviceDiscoveryTaskThread(void * request);
+
+  static const int DEVICE_COUNT = (int)DEVICE::Invalid;
+  const uint16_t ssdpport = 1900;
+
+  Preferences m_prefs;
+  SemaphoreHandle_t m_mutex = nullptr;         // held during a scan
+  SemaphoreHandle_t m_request_mutex = nullptr; // guards m_discovering
+  volatile uint32_t m_address[DEVICE_COUNT] = {};
+  String m_uuid[DEVICE_COUNT];
+  volatile bool m_discovering[DEVICE_COUNT] = {};
+};
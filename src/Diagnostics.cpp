@@ -0,0 +1,91 @@
+#include "Diagnostics.h"
+#include "esp_heap_caps.h"
+
+Diagnostics::Diagnostics(){
+}
+
+Diagnostics::~Diagnostics(){
+}
+
+Diagnostics::SAMPLE Diagnostics::Sample(){
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+
+  SAMPLE sample;
+  sample.time_ms                 = millis();
+  sample.heap_free               = info.total_free_bytes;
+  sample.heap_allocated          = info.total_allocated_bytes;
+  sample.heap_largest_free_block = info.largest_free_block;
+  sample.heap_minimum_free       = info.minimum_free_bytes;
+  sample.allocated_blocks        = info.allocated_blocks;
+
+  if(!m_has_baseline){
+    m_baseline = sample;
+    m_has_baseline = true;
+  }
+  UpdateStackBaselines();
+  return sample;
+}
+
+void Diagnostics::AddStack(const String & name, std::function<uint32_t()> high_water){
+  m_stacks.push_back(STACK{ name, high_water, 0 });
+}
+
+void Diagnostics::UpdateStackBaselines(){
+  // A task that had not run yet at the heap baseline takes its first measured value.
+  for(STACK & stack : m_stacks){
+    if(stack.baseline == 0){
+      stack.baseline = stack.high_water();
+    }
+  }
+}
+
+Diagnostics::SAMPLE Diagnostics::GetBaseline(){
+  return m_baseline;
+}
+
+void Diagnostics::Print(){
+  const SAMPLE sample = Sample();
+
+  Serial.printf("(DIAG)Uptime: %lu ms\r\n", (unsigned long)sample.time_ms);
+  Serial.printf("(DIAG)Heap free: %u (%+d)\r\n",
+    (unsigned)sample.heap_free, (int)sample.heap_free - (int)m_baseline.heap_free);
+  Serial.printf("(DIAG)Heap allocated: %u (%+d)\r\n",
+    (unsigned)sample.heap_allocated, (int)sample.heap_allocated - (int)m_baseline.heap_allocated);
+  Serial.printf("(DIAG)Largest free block: %u (%+d)\r\n",
+    (unsigned)sample.heap_largest_free_block, (int)sample.heap_largest_free_block - (int)m_baseline.heap_largest_free_block);
+  Serial.printf("(DIAG)Minimum free: %u\r\n", (unsigned)sample.heap_minimum_free);
+  Serial.printf("(DIAG)Allocated blocks: %u (%+d)\r\n",
+    (unsigned)sample.allocated_blocks, (int)sample.allocated_blocks - (int)m_baseline.allocated_blocks);
+  for(const STACK & stack : m_stacks){
+    const uint32_t high_water = stack.high_water();
+    Serial.printf("(DIAG)%s stack high-water: %lu (%+ld)\r\n",
+      stack.name.c_str(), (unsigned long)high_water, (long)high_water - (long)stack.baseline);
+  }
+}
+
+bool Diagnostics::Check(const LIMITS & limits){
+  const SAMPLE sample = Sample();
+  bool ok = true;
+
+  if(sample.heap_allocated > m_baseline.heap_allocated + limits.heap_allocated_growth){
+    Serial.printf("(DIAG)Heap allocated grew by %u\r\n", (unsigned)(sample.heap_allocated - m_baseline.heap_allocated));
+    ok = false;
+  }
+  if(sample.heap_largest_free_block + limits.largest_free_block_loss < m_baseline.heap_largest_free_block){
+    Serial.printf("(DIAG)Largest free block shrank by %u\r\n", (unsigned)(m_baseline.heap_largest_free_block - sample.heap_largest_free_block));
+    ok = false;
+  }
+  if(sample.allocated_blocks > m_baseline.allocated_blocks + limits.allocated_blocks_growth){
+    Serial.printf("(DIAG)Allocated blocks grew by %u\r\n", (unsigned)(sample.allocated_blocks - m_baseline.allocated_blocks));
+    ok = false;
+  }
+  for(const STACK & stack : m_stacks){
+    const uint32_t high_water = stack.high_water();
+    if(stack.baseline != 0 && high_water + limits.stack_high_water_loss < stack.baseline){
+      Serial.printf("(DIAG)%s stack high-water dropped by %lu\r\n", stack.name.c_str(), (unsigned long)(stack.baseline - high_water));
+      ok = false;
+    }
+  }
+  return ok;
+}
@@ -0,0 +1,75 @@
+// Diagnostics class reads heap counters to check long-running behavior on the device.
+//
+// Usage:
+// 1. Create an Instance
+//   Diagnostics diag;
+// 2. Take samples. The first one becomes the baseline.
+//   Diagnostics::SAMPLE sample = diag.Sample();
+// 3. Register stacks to watch
+//   diag.AddStack("HeosControl", [](){ return hc.GetStackHighWaterMark(); });
+// 4. Print counters and the drift from the baseline
+//   diag.Print();
+// 5. Check the drift against limits, e.g. after a soak run
+//   Diagnostics::LIMITS limits;
+//   limits.heap_allocated_growth = 512;
+//   diag.Check(limits);
+//
+// Note:
+// Counters cover the 8-bit capable heap used by malloc and new.
+// Stack high-water marks are read by the registered functions. A stack that reads 0 is not
+// measured yet and is skipped.
+
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+class Diagnostics {
+public:
+  struct SAMPLE {
+    uint32_t time_ms = 0;
+    size_t heap_free = 0;
+    size_t heap_allocated = 0;
+    size_t heap_largest_free_block = 0;
+    size_t heap_minimum_free = 0;  // lowest heap_free since boot
+    size_t allocated_blocks = 0;
+  };
+
+  // LIMITS gives how far each counter may drift from the baseline before Check() fails.
+  struct LIMITS {
+    size_t heap_allocated_growth = 0;
+    size_t largest_free_block_loss = 0;
+    size_t allocated_blocks_growth = 0;
+    uint32_t stack_high_water_loss = 0;
+  };
+
+  Diagnostics();
+  ~Diagnostics();
+
+  SAMPLE Sample();
+
+  SAMPLE GetBaseline();
+
+  /// @param high_water returns the free stack in bytes, or 0 if it is not measured yet.
+  void AddStack(const String & name, std::function<uint32_t()> high_water);
+
+  void Print();
+
+  /// Check takes a sample and prints each counter that drifted beyond limits.
+  /// @return true if all counters are within limits.
+  bool Check(const LIMITS & limits);
+
+private:
+  struct STACK {
+    String name;
+    std::function<uint32_t()> high_water;
+    uint32_t baseline; // 0 until a measured value is taken as the baseline
+  };
+
+  void UpdateStackBaselines();
+
+  bool m_has_baseline = false;
+  SAMPLE m_baseline;
+  std::vector<STACK> m_stacks;
+};
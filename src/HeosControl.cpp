@@ -1,8 +1,9 @@
-
+#include <algorithm>
 #include <unordered_map>
 #include "HeosControl.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 namespace {
   const std::unordered_map<HeosControl::COMMAND, String> COMMAND_LIST = {
@@ -32,12 +33,28 @@ namespace {
   String GetInputSourceName(HeosControl::INPUT_SOURCE input){
     return INPUT_SOURCE_LIST.count(input) > 0 ? INPUT_SOURCE_LIST.at(input) : String();
   }
+
+  // Commands that leave the device in the same state however often they run.
+  // Relative ones such as volume_up would be applied twice if the first send got through.
+  bool IsIdempotent(HeosControl::COMMAND cmd){
+    switch(cmd){
+      case HeosControl::COMMAND::GetPlayers:
+      case HeosControl::COMMAND::SetVolume:
+      case HeosControl::COMMAND::SetMute:
+      case HeosControl::COMMAND::PlayInputSource:
+        return true;
+      default:
+        return false;
+    }
+  }
 }
 
 HeosControl::HeosControl(){
+  m_queue_mutex = xSemaphoreCreateMutex();
 }
 
 HeosControl::~HeosControl(){
+  vSemaphoreDelete(m_queue_mutex);
 }
 
 void HeosControlTaskThread(void * hc){
@@ -48,75 +65,372 @@ void HeosControlTaskThread(void * hc){
 void HeosControl::CommandHandler(){
   Serial.printf("(HEOS)CommandHandler started\r\n");
 
-  while(m_self.connected()){
-    if(m_task_queue.empty()){
+  uint32_t last_traffic_ms = millis();
+  bool busy = false;
+
+  while(m_running){
+    if(!m_self.connected()){
+      if(!Reconnect()){
+        DropExpiredTasks();
+        continue;
+      }
+      last_traffic_ms = millis();
+    }
+
+    std::vector<TASK> tasks = TakeTasks();
+    if(tasks.empty()){
+      if(busy){
+        UpdateStackHighWaterMark();
+        busy = false;
+      }
+      if(m_self.available()){
+        // Unsolicited lines are routed while idle. The rest of a line follows shortly.
+        RouteMessage(WaitJsonResponse(100));
+        last_traffic_ms = millis();
+        continue;
+      }
+      if(millis() - last_traffic_ms > heartbeat_interval_ms){
+        if(!HeartBeat()){
+          Serial.printf("(HEOS)Heartbeat failed\r\n");
+          m_self.stop();
+        }
+        last_traffic_ms = millis();
+      }
       delay(10);
       continue;
     }
+    busy = true;
 
-    const TASK task = m_task_queue.front();
+    // Tasks of a batch are sent in one write.
+    String uris;
+    for(const TASK & task : tasks){
+      uris += task.uri;
+    }
+    Serial.printf("(HEOS)Send: %s", uris.c_str());
+    m_self.print(uris);
+
+    if(!WaitResponses(tasks)){
+      Serial.printf("(HEOS)Heartbeat failed\r\n");
+      m_self.stop();
+      // The socket may be half-open. Then unanswered tasks are resent after reconnecting.
+      RequeueTasks(tasks);
+    }else if(!tasks.empty()){
+      Serial.printf("(HEOS)Dropped %u unanswered task(s)\r\n", (unsigned)tasks.size());
+      for(const TASK & task : tasks){
+        ReportResult(task, false);
+      }
+    }
+    last_traffic_ms = millis();
+  }
 
-    Serial.printf("(HEOS)Send: %s", task.uri.c_str());
-    m_self.print(task.uri);
+  UpdateStackHighWaterMark();
+  Serial.printf("(HEOS)CommandHandler stopped\r\n");
+  m_handler_running = false;
+}
 
-    auto response = WaitJsonResponse(500);
-    if(response.isEmpty()){
+std::vector<HeosControl::TASK> HeosControl::TakeTasks(){
+  DropExpiredTasks();
+
+  std::vector<TASK> tasks;
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  if(!m_task_queue.empty()){
+    // Commit() pushes a batch as a whole, so all of its tasks are in the queue.
+    const size_t count = m_task_queue.front().batch_size;
+    tasks.assign(m_task_queue.begin(), m_task_queue.begin() + count);
+    m_task_queue.erase(m_task_queue.begin(), m_task_queue.begin() + count);
+  }
+  xSemaphoreGive(m_queue_mutex);
+  return tasks;
+}
+
+void HeosControl::RequeueTasks(const std::vector<TASK> & tasks){
+  // The device may have run a command before the connection broke.
+  std::vector<TASK> resend;
+  for(const TASK & task : tasks){
+    if(IsIdempotent(task.cmd)){
+      resend.push_back(task);
+    }else{
+      Serial.printf("(HEOS)Not resent: %s", task.uri.c_str());
+      ReportResult(task, false);
+    }
+  }
+
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  // Tasks kept for resending still form a batch.
+  for(size_t i = resend.size(); i-- > 0;){
+    m_task_queue.push_front(resend[i]);
+    m_task_queue.front().batch_size = resend.size() - i;
+  }
+  xSemaphoreGive(m_queue_mutex);
+}
+
+void HeosControl::DropExpiredTasks(){
+  std::vector<TASK> expired;
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  while(!m_task_queue.empty() && millis() - m_task_queue.front().queued_ms > task_expire_ms){
+    expired.push_back(m_task_queue.front());
+    m_task_queue.pop_front();
+  }
+  xSemaphoreGive(m_queue_mutex);
+
+  // The result callback may queue commands, so it is called without the lock.
+  for(const TASK & task : expired){
+    Serial.printf("(HEOS)Task expired: %s", task.uri.c_str());
+    ReportResult(task, false);
+  }
+}
+
+bool HeosControl::HasQueuedTasks(){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  const bool queued = !m_task_queue.empty();
+  xSemaphoreGive(m_queue_mutex);
+  return queued;
+}
+
+bool HeosControl::WaitResponses(std::vector<TASK> & tasks){
+  uint32_t deadline_ms = millis() + response_timeout_ms;
+
+  while(!tasks.empty()){
+    const int32_t wait_ms = (int32_t)(deadline_ms - millis());
+    const String line = wait_ms > 0 ? WaitJsonResponse(wait_ms) : String();
+    if(line.isEmpty()){
       Serial.print("(HEOS)Missing response\r\n"); 
-      m_task_queue.pop();
-      continue;
+      // Responses that arrive before the heartbeat answer still complete their tasks.
+      return HeartBeat(&tasks);
     }
-    
-    Serial.printf("(HEOS)Recv: %s", response.c_str());
 
-    DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, response.c_str());
-    if(error){
-      Serial.printf("Invalid response: %s\r\n", error.c_str());
-      m_task_queue.pop();
+    DynamicJsonDocument doc(GetDocumentCapacity(line));
+    const MESSAGE type = ParseMessage(line, doc);
+    if(type == MESSAGE::Event || type == MESSAGE::Unknown){
+      RouteMessage(type, doc);
       continue;
     }
 
-    String response_heos_command = doc["heos"]["command"];
-    String response_heos_result  = doc["heos"]["result"];
-    
-    if(GetCommandName(task.cmd) != response_heos_command){
-      Serial.printf("(HEOS)Command mismatch\r\n");
-      m_task_queue.pop();
+    if(!MatchResponse(type, doc, tasks)){
+      Serial.printf("(HEOS)Unexpected response\r\n");
       continue;
     }
 
-    if(response_heos_result != "success"){
-      Serial.printf("(HEOS)Command failure\r\n");
-      m_task_queue.pop();
-      continue;
+    if(type == MESSAGE::Interim){
+      Serial.printf("(HEOS)Command under process\r\n");
     }
+    // A final response to another task does not cut short the wait for one under process.
+    const bool interim = std::any_of(tasks.begin(), tasks.end(), [](const TASK & task){ return task.interim; });
+    deadline_ms = millis() + (interim ? interim_timeout_ms : response_timeout_ms);
+  }
+  return true;
+}
+
+bool HeosControl::MatchResponse(MESSAGE type, DynamicJsonDocument & doc, std::vector<TASK> & tasks){
+  // Responses are matched by command name because interim results may reorder them.
+  const String command = doc["heos"]["command"] | "";
+  auto task = tasks.begin();
+  while(task != tasks.end() && GetCommandName(task->cmd) != command){
+    task++;
+  }
+  if(task == tasks.end()){
+    return false;
+  }
+  if(type == MESSAGE::Response){
+    HandleResponse(*task, doc);
+    tasks.erase(task);
+  }else{
+    task->interim = true;
+  }
+  return true;
+}
+
+void HeosControl::HandleResponse(const TASK & task, DynamicJsonDocument & doc){
+  String response_heos_result = doc["heos"]["result"];
+
+  if(response_heos_result != "success"){
+    Serial.printf("(HEOS)Command failure\r\n");
+    ReportResult(task, false);
+    return;
+  }
+
+  if(task.response_callback){
+    task.response_callback(doc);
+  }
+  ReportResult(task, true);
+}
+
+void HeosControl::ReportResult(const TASK & task, bool success){
+  if(m_result_callback){
+    m_result_callback(task.cmd, success);
+  }
+}
+
+HeosControl::MESSAGE HeosControl::ParseMessage(const String & line, DynamicJsonDocument & doc){
+  Serial.printf("(HEOS)Recv: %s", line.c_str());
+
+  DeserializationError error = deserializeJson(doc, line.c_str());
+  if(error){
+    Serial.printf("Invalid response: %s\r\n", error.c_str());
+    return MESSAGE::Unknown;
+  }
+
+  JsonObject heos = doc["heos"];
+  const String command = heos["command"] | "";
+  if(command.isEmpty()){
+    return MESSAGE::Unknown;
+  }
+  if(command.startsWith("event/")){
+    return MESSAGE::Event;
+  }
+
+  const String message = heos["message"] | "";
+  if(message.startsWith("command under process")){
+    return MESSAGE::Interim;
+  }
+  if(heos.containsKey("result")){
+    return MESSAGE::Response;
+  }
+  return MESSAGE::Unknown;
+}
 
-    if(task.response_callback){
-      task.response_callback(doc);
+// Each member and element takes one slot, and copied strings are never longer than their text.
+// A collection of n values has n - 1 commas and one opening bracket, so counting ',', '[' and '{'
+// gives the number of slots from above without parsing. Characters inside strings are counted
+// too, which only adds margin.
+size_t HeosControl::GetDocumentCapacity(const String & json){
+  size_t slots = 1;
+  for(const char * p = json.c_str(); *p != '\0'; p++){
+    if(*p == ',' || *p == '[' || *p == '{'){
+      slots++;
     }
-    m_task_queue.pop();
   }
+  const size_t max_capacity = 32768;
+  const size_t capacity = JSON_ARRAY_SIZE(slots) + json.length();
+  return capacity < max_capacity ? capacity : max_capacity;
+}
 
-  Serial.printf("(HEOS)CommandHandler stopped\r\n");
+void HeosControl::RouteMessage(MESSAGE type, DynamicJsonDocument & doc){
+  if(type != MESSAGE::Event){
+    Serial.printf("(HEOS)Unexpected message\r\n");
+    return;
+  }
+
+  for(auto & event_callback : m_event_callbacks){
+    event_callback(doc);
+  }
+}
+
+void HeosControl::RouteMessage(const String & line){
+  if(line.isEmpty()){
+    return;
+  }
+  DynamicJsonDocument doc(GetDocumentCapacity(line));
+  RouteMessage(ParseMessage(line, doc), doc);
+}
+
+bool HeosControl::HeartBeat(std::vector<TASK> * tasks){
+  const String uri = String("heos://system/heart_beat\r\n");
+  m_self.print(uri);
+
+  // Late responses and events may arrive first.
+  uint32_t start_ms = millis();
+  while(millis() - start_ms < 1000){
+    auto response = WaitJsonResponse(500);
+    if(response.isEmpty()){
+      return false;
+    }
+    DynamicJsonDocument doc(GetDocumentCapacity(response));
+    const MESSAGE type = ParseMessage(response, doc);
+    if(type == MESSAGE::Response && doc["heos"]["command"] == "system/heart_beat"){
+      return true;
+    }
+    if(type == MESSAGE::Event){
+      RouteMessage(type, doc);
+    }else if(tasks != nullptr && (type == MESSAGE::Response || type == MESSAGE::Interim)){
+      if(!MatchResponse(type, doc, *tasks)){
+        Serial.printf("(HEOS)Unexpected response\r\n");
+      }
+    }
+  }
+  return false;
+}
+
+bool HeosControl::Reconnect(){
+  if(WiFi.status() != WL_CONNECTED){
+    // Retry immediately once the network is back.
+    m_backoff.Reset();
+    delay(100);
+    return false;
+  }
+
+  // A queued command shortens a long backoff so that it lands soon after the device is back.
+  const uint32_t wait_ms = m_backoff.Next();
+  const uint32_t queued_wait_ms = 250;
+  uint32_t spent = 0;
+  // A new address from discovery is tried at once.
+  while(spent < wait_ms && m_running && m_new_address == 0){
+    if(spent >= queued_wait_ms && HasQueuedTasks()){
+      break;
+    }
+    spent += 10;
+    delay(10);
+  }
+  if(!m_running){
+    return false;
+  }
+
+  const uint32_t new_address = m_new_address;
+  if(new_address != 0){
+    m_new_address = 0;
+    if(new_address != (uint32_t)m_heosdevice){
+      m_heosdevice = IPAddress(new_address);
+      Serial.printf("(HEOS)Device moved to %s\r\n", m_heosdevice.toString().c_str());
+      m_backoff.Reset();
+    }
+  }
+
+  if(!m_self.connect(m_heosdevice, heosport)){
+    Serial.printf("(HEOS)Reconnect failed\r\n");
+    // Discovery runs in the background once per outage. Its result comes by UpdateAddress().
+    if(m_rediscover && !m_rediscover_requested){
+      m_rediscover_requested = true;
+      m_rediscover();
+    }
+    return false;
+  }
+  m_self.setNoDelay(true);
+  m_line = String();
+  m_line_overflow = false;
+  Serial.printf("(HEOS)Reconnected\r\n");
+  m_backoff.Reset();
+  m_rediscover_requested = false;
+  return true;
 }
 
 bool HeosControl::Connect(const IPAddress heosdevice, bool reuse_pid){
-  if(m_self.connected()){
+  if(m_running || m_self.connected()){
     Disconnect();
   }
 
 // FYI: WiFiClient::connect sometimes fail. Then, Please wait 30 sec. and retry.
-  m_self.connect(heosdevice, heosport);
-  delay(100);
-  if(!m_self.connected()){
+  if(!m_self.connect(heosdevice, heosport)){
     Serial.printf("(HEOS)Cannot connect to HEOS device\r\n");
     return false;
   }
+  // Commands are small and a batch is a single write, so Nagle only adds delay.
+  m_self.setNoDelay(true);
+  m_line = String();
+  m_line_overflow = false;
   Serial.printf("(HEOS)Connected\r\n");
 
-  std::queue<TASK> empty_queue;
-  m_task_queue.swap(empty_queue);
-
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  m_task_queue.clear();
+  m_batch.clear();
+  m_batching = false;
+  xSemaphoreGive(m_queue_mutex);
+
+  m_heosdevice = heosdevice;
+  m_backoff.Reset();
+  m_new_address = 0;
+  m_rediscover_requested = false;
+  m_running = true;
+  m_handler_running = true;
   xTaskCreatePinnedToCore(HeosControlTaskThread, "HeosControl::CommandHandler", 8192, (void*)this, 1, nullptr, 0);
   
   if(m_pid != 0 && reuse_pid){
@@ -136,20 +450,34 @@ bool HeosControl::Connect(const IPAddress heosdevice, bool reuse_pid){
     return false;
   }
 
-  while(1){
+  uint32_t spent = 0;
+  const uint32_t timeout_ms = 5000;
+  while(!updated){
+    if(spent > timeout_ms){
+      Serial.printf("(HEOS)Cannot get player_id\r\n");
+      Disconnect();
+      return false;
+    }
+    spent += 1;
     delay(1);
-    if(updated){break;}
   }
 
   return true;
 }
 
 bool HeosControl::Disconnect(){
-  if(!m_self.connected()){
+  if(!m_running){
+    m_self.stop();
     return true;
   }
 
-  while(!m_task_queue.empty()){
+  // Tasks queued while reconnecting are not waited for. They would expire anyway.
+  while(HasQueuedTasks() && m_self.connected()){
+    delay(1);
+  }
+
+  m_running = false;
+  while(m_handler_running){
     delay(1);
   }
 
@@ -158,25 +486,112 @@ bool HeosControl::Disconnect(){
   return true;
 }
 
+bool HeosControl::IsConnected(){
+  return m_self.connected();
+}
+
+bool HeosControl::IsStarted(){
+  return m_running;
+}
+
+void HeosControl::AddEventCallback(std::function<void(DynamicJsonDocument)> event_callback){
+  m_event_callbacks.push_back(event_callback);
+}
+
+void HeosControl::SetResultCallback(std::function<void(COMMAND, bool)> result_callback){
+  m_result_callback = result_callback;
+}
+
+void HeosControl::SetRediscoverCallback(std::function<void()> rediscover){
+  m_rediscover = rediscover;
+}
+
+void HeosControl::UpdateAddress(IPAddress address){
+  m_new_address = (uint32_t)address;
+}
+
+void HeosControl::BeginBatch(){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  m_batch.clear();
+  m_batching = true;
+  xSemaphoreGive(m_queue_mutex);
+}
+
+bool HeosControl::Commit(){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  if(!m_batching){
+    xSemaphoreGive(m_queue_mutex);
+    return false;
+  }
+  m_batching = false;
+
+  // The batch is pushed under the lock, so CommandHandler never sees part of it.
+  const size_t count = m_batch.size();
+  for(size_t i = 0; i < count; i++){
+    m_batch[i].batch_size = count - i;
+    m_task_queue.push_back(m_batch[i]);
+  }
+  m_batch.clear();
+  xSemaphoreGive(m_queue_mutex);
+  return count > 0;
+}
+
+void HeosControl::PushTask(const TASK & task){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  if(m_batching){
+    m_batch.push_back(task);
+  }else{
+    m_task_queue.push_back(task);
+  }
+  xSemaphoreGive(m_queue_mutex);
+}
+
+uint32_t HeosControl::GetStackHighWaterMark(){
+  return m_stack_high_water;
+}
+
+void HeosControl::UpdateStackHighWaterMark(){
+  const uint32_t mark = uxTaskGetStackHighWaterMark(NULL);
+  if(m_stack_high_water == 0 || mark < m_stack_high_water){
+    m_stack_high_water = mark;
+  }
+}
+
 String HeosControl::WaitJsonResponse(uint32_t timeout_ms){
-  String response;
   uint32_t spent = 0;
 
 // FYI: Delimiter of HEOS CLI protocol is "\r\n" 
   while(1){
     if(!m_self.available()){
       if(spent > timeout_ms){
+        // The part read so far stays in m_line and is completed by the next call.
         return String();
       }
-      spent += 10;
-      delay(10);
+      spent += 1;
+      delay(1);
       continue;
     }
 
     char c = m_self.read();
-    response += c;
+    if(m_line.isEmpty()){
+      m_line.reserve(128);
+    }
+    if(m_line.length() < max_response_length){
+      m_line += c;
+    }else{
+      m_line_overflow = true;
+    }
 
     if(c == '\n'){
+      String response;
+      if(m_line_overflow){
+        // Rest of the line is discarded so that the next line starts clean.
+        Serial.printf("(HEOS)Response too long\r\n");
+      }else{
+        response = m_line;
+      }
+      m_line = String();
+      m_line_overflow = false;
       return response;
     }
   }
@@ -187,7 +602,7 @@ String HeosControl::WaitJsonResponse(uint32_t timeout_ms){
 bool HeosControl::GetPlayers(std::function<void(DynamicJsonDocument)> response_callback){
   const String uri = String("heos://") + GetCommandName(COMMAND::GetPlayers) + String("\r\n");
   Serial.print(uri);
-  m_task_queue.push(TASK(COMMAND::GetPlayers, uri, response_callback));
+  PushTask(TASK(COMMAND::GetPlayers, uri, response_callback));
   return true;
 }
 
@@ -196,7 +611,7 @@ bool HeosControl::SetVolume(unsigned int level){
     return false;
   }
   const auto uri = String("heos://") + GetCommandName(COMMAND::SetVolume) + String("?pid=") + String(m_pid) + String("&level=") + String(level) + String("\r\n");
-  m_task_queue.push(TASK(COMMAND::SetVolume, uri));
+  PushTask(TASK(COMMAND::SetVolume, uri));
   return true;
 }
 
@@ -205,7 +620,7 @@ bool HeosControl::VolumeUp(unsigned int step){
     return false;
   }
   const auto uri = String("heos://") + GetCommandName(COMMAND::VolumeUp) + String("?pid=") + String(m_pid) + String("&step=") + String(step) + String("\r\n");
-  m_task_queue.push(TASK(COMMAND::VolumeUp, uri));
+  PushTask(TASK(COMMAND::VolumeUp, uri));
   return true;
 }
 
@@ -214,25 +629,25 @@ bool HeosControl::VolumeDown(unsigned int step){
     return false;
   }
   const auto uri = String("heos://") + GetCommandName(COMMAND::VolumeDown) + String("?pid=") + String(m_pid) + String("&step=") + String(step) + String("\r\n");
-  m_task_queue.push(TASK(COMMAND::VolumeDown, uri));
+  PushTask(TASK(COMMAND::VolumeDown, uri));
   return true;
 }
 
 bool HeosControl::SetMute(bool state){
   const auto uri = String("heos://") + GetCommandName(COMMAND::SetMute) + String("?pid=") + String(m_pid) + (state ? String("&state=on\r\n") : String("&state=off\r\n"));
-  m_task_queue.push(TASK(COMMAND::SetMute, uri));
+  PushTask(TASK(COMMAND::SetMute, uri));
   return true;
 }
 
 bool HeosControl::ToggleMute(){
   const auto uri = String("heos://") + GetCommandName(COMMAND::ToggleMute) + String("?pid=") + String(m_pid) + String("\r\n");
-  m_task_queue.push(TASK(COMMAND::ToggleMute, uri));
+  PushTask(TASK(COMMAND::ToggleMute, uri));
   return true;
 }
 
 bool HeosControl::PlayInputSource(INPUT_SOURCE input){
   const auto uri = String("heos://") + GetCommandName(COMMAND::PlayInputSource) + String("?pid=") + String(m_pid) + String("&input=") + GetInputSourceName(input) + String("\r\n");
-  m_task_queue.push(TASK(COMMAND::PlayInputSource, uri));
+  PushTask(TASK(COMMAND::PlayInputSource, uri));
   return true;
 }
 
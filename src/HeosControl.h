@@ -12,6 +12,11 @@
 //   hc.VolumeUp();
 //   hc.ToggleMute();
 //   ...
+//   Commands between BeginBatch() and Commit() are sent in one write
+//   hc.BeginBatch();
+//   hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
+//   hc.SetVolume(25);
+//   hc.Commit();
 // 4. Disconnect
 //   hc.Disconnect();
 // 5. Reconnect
@@ -20,11 +25,20 @@
 // Note:
 // HeosControl does not support all commands.
 // Error handling is incomplete. Some APIs could get stuck.
+// After Connect() succeeds, CommandHandler sends system/heart_beat on an idle connection and
+// reconnects in the background if the device stops answering. Commands are kept in the queue
+// while reconnecting and are dropped if they wait longer than task_expire_ms.
+// Commands that were sent but not answered are resent after reconnecting only if running them
+// twice does no harm, i.e. SetVolume, SetMute, PlayInputSource and GetPlayers.
+
+#pragma once
 
 #include <WiFi.h>
 #include <functional>
 #include <ArduinoJson.h>
-#include <queue>
+#include <deque>
+#include <vector>
+#include "Backoff.h"
 
 class HeosControl {
 public:
@@ -57,6 +71,24 @@ public:
   bool Connect(const IPAddress heosdevice, bool reuse_pid = false);
   bool Disconnect();
 
+  /// @return true if the CLI socket is connected.
+  bool IsConnected();
+
+  /// @return true from Connect() until Disconnect(). Commands are accepted even while reconnecting.
+  bool IsStarted();
+
+  /// @return minimum free stack of CommandHandler tasks in bytes. 0 if not measured yet.
+  uint32_t GetStackHighWaterMark();
+
+  /// @param rediscover is called by CommandHandler when a reconnect fails, once until a reconnect
+  /// succeeds. It must not block. It starts finding the device and reports by UpdateAddress().
+  void SetRediscoverCallback(std::function<void()> rediscover);
+
+  /// UpdateAddress gives the current address of the device. It may be called from any task.
+  /// A reconnect to a changed address is tried without waiting for the backoff.
+  /// 0.0.0.0 is ignored.
+  void UpdateAddress(IPAddress address);
+
 //----- HEOS Commands -----//
   // Any HEOS commands return true if succeeded, false if not.
 
@@ -79,30 +111,145 @@ public:
 
   bool PlayInputSource(INPUT_SOURCE input);
 
+//----- Batch -----//
+  // Commands called after BeginBatch() are held until Commit().
+  // Commit() queues them together at once. CommandHandler sends them in one write and then
+  // waits for their responses in order.
+
+  void BeginBatch();
+
+  /// @return false if BeginBatch() was not called or no command was added.
+  bool Commit();
+
+//----- Events -----//
+  // Change events and other unsolicited messages are passed to event callbacks
+  // instead of being taken as responses.
+  // Call AddEventCallback() before Connect(). Callbacks are called from CommandHandler.
+  void AddEventCallback(std::function<void(DynamicJsonDocument)> event_callback);
+
+//----- Results -----//
+  // The result callback is called once for each command: with true when the device reports
+  // success, and with false when it reports a failure or the command is dropped unanswered.
+  // Commands still queued at Disconnect() or Connect() are not reported.
+  // Call SetResultCallback() before Connect(). It is called from CommandHandler.
+  void SetResultCallback(std::function<void(COMMAND, bool)> result_callback);
+
 //----- Others -----//
   // CommandHandler is used as private
   void CommandHandler();
 
 private:
-  /// WaitJsonResponse could get stuck because it does not check timeout.
+  /// WaitJsonResponse reads one line. A line that is not complete at timeout is kept in m_line
+  /// and continued by the next call. Lines longer than max_response_length are discarded.
   /// @return JSON formatted string if succeeded. Return empty String if failed.
   String WaitJsonResponse(uint32_t timeout_ms = 5000);
 
+  /// UpdateStackHighWaterMark is called by CommandHandler after it becomes idle.
+  void UpdateStackHighWaterMark();
+
+  /// Reconnect waits for the backoff delay and then tries once.
+  /// @return true if connected.
+  bool Reconnect();
+
   struct TASK {
     COMMAND cmd;
     String uri;
     std::function<void(DynamicJsonDocument)> response_callback;
+    uint32_t queued_ms;
+    size_t batch_size; // number of tasks from this one to the end of its batch
+    bool interim;      // true after "command under process" until the final response
 
     TASK(COMMAND cmd_in, String uri_in, std::function<void(DynamicJsonDocument)> response_callback_in = nullptr){
       cmd = cmd_in;
       uri = uri_in;
       response_callback = response_callback_in;
+      queued_ms = millis();
+      batch_size = 1;
+      interim = false;
     }
   };
 
-  std::queue<TASK> m_task_queue;
+  enum class MESSAGE {
+    Response, // final result of a command
+    Interim,  // "command under process". The final result follows later.
+    Event,    // change event
+    Unknown
+  };
+
+  // m_task_queue and m_batch are shared with the callers of the commands and are accessed
+  // under m_queue_mutex only.
+  void PushTask(const TASK & task);
+
+  /// @return tasks of the next batch, removed from the queue. Empty if the queue is empty.
+  std::vector<TASK> TakeTasks();
+
+  /// RequeueTasks puts the idempotent ones of tasks back to the front of the queue as one batch.
+  /// The others are dropped because they may have been run already.
+  void RequeueTasks(const std::vector<TASK> & tasks);
+
+  void DropExpiredTasks();
+  bool HasQueuedTasks();
+
+  /// WaitResponses waits for final responses to tasks and removes the answered ones.
+  /// Other messages are routed meanwhile. It waits interim_timeout_ms for the next message while
+  /// any task is under process, and response_timeout_ms otherwise.
+  /// @return false if the device does not answer.
+  bool WaitResponses(std::vector<TASK> & tasks);
+
+  /// @param tasks is given while tasks wait for responses. Late responses that arrive before
+  /// the heartbeat answer are matched to them as WaitResponses() does.
+  /// @return true if the device answered system/heart_beat.
+  bool HeartBeat(std::vector<TASK> * tasks = nullptr);
+
+  /// MatchResponse finds the first task whose command matches a response or an interim result.
+  /// A task that got its final response is handled and removed from tasks. A task that got an
+  /// interim result is marked interim.
+  /// @return false if no task matched.
+  bool MatchResponse(MESSAGE type, DynamicJsonDocument & doc, std::vector<TASK> & tasks);
+
+  /// HandleResponse checks the result of a final response to task and calls its response_callback.
+  void HandleResponse(const TASK & task, DynamicJsonDocument & doc);
+
+  /// ReportResult passes the result of task to the result callback.
+  void ReportResult(const TASK & task, bool success);
+
+  /// ParseMessage parses and classifies a line.
+  MESSAGE ParseMessage(const String & line, DynamicJsonDocument & doc);
+
+  /// @return capacity of a document that holds json parsed. It is capped so that a hostile line
+  /// cannot ask for more than the heap has.
+  static size_t GetDocumentCapacity(const String & json);
+
+  /// RouteMessage passes events to event callbacks and logs other messages.
+  void RouteMessage(MESSAGE type, DynamicJsonDocument & doc);
+  void RouteMessage(const String & line);
+
+  SemaphoreHandle_t m_queue_mutex = nullptr;
+  std::deque<TASK> m_task_queue;
+  std::vector<TASK> m_batch;
+  bool m_batching = false;
+  std::vector<std::function<void(DynamicJsonDocument)>> m_event_callbacks;
+  std::function<void(COMMAND, bool)> m_result_callback = nullptr;
+  std::function<void()> m_rediscover = nullptr;
+  bool m_rediscover_requested = false;      // true after m_rediscover was called in this outage
+  volatile uint32_t m_new_address = 0;      // set by UpdateAddress() and taken by Reconnect()
   const uint16_t heosport = 1255;
+  const size_t max_response_length = 8192;
+  const uint32_t response_timeout_ms = 500;
+  const uint32_t interim_timeout_ms = 5000;
+  const uint32_t heartbeat_interval_ms = 10000;
+  const uint32_t task_expire_ms = 10000;
+  IPAddress m_heosdevice;
   WiFiClient m_self;
+  String m_line;                // received part of the current line
+  bool m_line_overflow = false; // true if the current line exceeded max_response_length
   long m_pid = 0;
-};
 
+  volatile bool m_running = false;         // true from Connect() until Disconnect()
+  volatile bool m_handler_running = false; // true while CommandHandler runs
+  Backoff m_backoff = Backoff(250, 30000);
+  volatile uint32_t m_stack_high_water = 0;
+
+  // HeosControlProbe gives the native tests in test/ access to the parser, the framing and the task queue.
+  friend class HeosControlProbe;
+};
@@ -2,6 +2,8 @@
 #include <unordered_map>
 #include <Arduino.h>
 #include <WiFi.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "LgtvControl.h"
 
 namespace {
@@ -14,9 +16,48 @@ namespace {
     { LgtvControl::InputId::HDMI4, String("HDMI_4") }
   };
 
+  const std::unordered_map<LgtvControl::InputId, String> APPID_LIST = {
+    { LgtvControl::InputId::HDMI1, String("com.webos.app.hdmi1") },
+    { LgtvControl::InputId::HDMI2, String("com.webos.app.hdmi2") },
+    { LgtvControl::InputId::HDMI3, String("com.webos.app.hdmi3") },
+    { LgtvControl::InputId::HDMI4, String("com.webos.app.hdmi4") }
+  };
+
   String GetInputIdString(LgtvControl::InputId id){
     return INPUTID_LIST.count(id) > 0 ? INPUTID_LIST.at(id) : String();
   }
+
+  LgtvControl::InputId FindInputId(const std::unordered_map<LgtvControl::InputId, String> & list, const String & name){
+    for(const auto & item : list){
+      if(item.second == name){
+        return item.first;
+      }
+    }
+    return LgtvControl::InputId::Invalid;
+  }
+
+  uint8_t GetInputBit(LgtvControl::InputId id){
+    return id == LgtvControl::InputId::Invalid ? 0 : (uint8_t)(1 << (int)id);
+  }
+
+  // Inbound messages are parsed through this filter so that only the fields used by
+  // LgtvControl are stored. getExternalInputList responses are several KB otherwise.
+  const DynamicJsonDocument & GetTextFilter(){
+    static DynamicJsonDocument filter(512);
+    if(filter.isNull()){
+      filter["id"]                                    = true;
+      filter["type"]                                  = true;
+      filter["payload"]["returnValue"]                = true;
+      filter["payload"]["client-key"]                 = true;
+      filter["payload"]["appId"]                      = true;
+      filter["payload"]["volume"]                     = true;
+      filter["payload"]["mute"]                       = true;
+      filter["payload"]["volumeStatus"]["volume"]     = true;
+      filter["payload"]["volumeStatus"]["muteStatus"] = true;
+      filter["payload"]["devices"][0]["id"]           = true;
+    }
+    return filter;
+  }
 }
 
 void LgtvControlTaskThread(void * lc){
@@ -25,29 +66,99 @@ void LgtvControlTaskThread(void * lc){
 }
 
 LgtvControl::LgtvControl(){
+  m_queue_mutex = xSemaphoreCreateMutex();
 }
 
 LgtvControl::~LgtvControl(){
+  vSemaphoreDelete(m_queue_mutex);
 }
 
 String LgtvControl::GetClientKey(){
   return m_clientkey;
 }
 
-bool LgtvControl::Connect(const IPAddress lgtv, String clientkey){
-  if(m_webSocket.isConnected()){
-    Disconnect();
+bool LgtvControl::IsRegistered(){
+  return m_state == STATE_REGISTERED;
+}
+
+const LgtvControl::TvState & LgtvControl::GetState(){
+  return m_tv;
+}
+
+uint32_t LgtvControl::GetStackHighWaterMark(){
+  return m_stack_high_water;
+}
+
+void LgtvControl::UpdateStackHighWaterMark(){
+  const uint32_t mark = uxTaskGetStackHighWaterMark(NULL);
+  if(m_stack_high_water == 0 || mark < m_stack_high_water){
+    m_stack_high_water = mark;
+  }
+}
+
+void LgtvControl::SetResultCallback(std::function<void(InputId, bool)> result_callback){
+  m_result_callback = result_callback;
+}
+
+void LgtvControl::SetRediscoverCallback(std::function<void()> rediscover){
+  m_rediscover = rediscover;
+}
+
+void LgtvControl::UpdateAddress(IPAddress address){
+  m_new_address = (uint32_t)address;
+}
+
+void LgtvControl::ApplyNewAddress(){
+  const uint32_t new_address = m_new_address;
+  if(new_address == 0){
+    return;
   }
+  m_new_address = 0;
+  if(new_address == (uint32_t)m_lgtv || m_state != STATE_DISCONNECTED){
+    return;
+  }
+
+  m_lgtv = IPAddress(new_address);
+  Serial.printf("(LGTV)TV moved to %s\r\n", m_lgtv.toString().c_str());
+  m_webSocket.begin(m_lgtv, lgtvport);
+  m_failed_attempts = 0;
+  m_backoff.Reset();
+  m_attempt_ms = millis();
+  m_reconnect_ms = m_backoff.Next();
+  m_webSocket.setReconnectInterval(m_reconnect_ms);
+}
+
+bool LgtvControl::IsStarted(){
+  return m_handler_running && m_state != STATE_HALT;
+}
+
+bool LgtvControl::Connect(const IPAddress lgtv, String clientkey){
+  Disconnect();
 
   m_clientkey = clientkey;
   m_state = STATE_DISCONNECTED;
 
+  // The input list is kept as long as the TV is the same one.
+  const bool inputs_known = m_tv.inputs_known && m_lgtv == lgtv;
+  const uint8_t inputs = m_tv.inputs;
+  m_tv = TvState();
+  m_tv.inputs_known = inputs_known;
+  m_tv.inputs = inputs_known ? inputs : 0;
+  m_lgtv = lgtv;
+
+  m_backoff.Reset();
+  m_failed_attempts = 0;
+  m_rediscover_requested = false;
+  m_new_address = 0;
+  m_attempt_ms = millis();
+  m_reconnect_ms = m_backoff.Next();
   m_webSocket.begin(lgtv, lgtvport);
   m_webSocket.onEvent([this](WStype_t type, uint8_t * payload, size_t length){WebSocketEventHandler(type, payload, length);});
-  m_webSocket.setReconnectInterval(5000);
+  m_webSocket.setReconnectInterval(m_reconnect_ms);
+  m_webSocket.enableHeartbeat(ping_interval_ms, pong_timeout_ms, pong_missing_count);
 
-  std::queue<TASK> empty_queue;
-  m_task_queue.swap(empty_queue);
+  ClearTasks();
+  m_handler_running = true;
   xTaskCreatePinnedToCore(LgtvControlTaskThread, "LgtvControl::CommandHandler", 8192, (void*)this, 1, nullptr, 0);
 
   uint32_t spent = 0;
@@ -64,11 +175,16 @@ bool LgtvControl::Connect(const IPAddress lgtv, String clientkey){
 }
 
 void LgtvControl::Disconnect(){
-  if(!m_webSocket.isConnected()){
+  if(!m_handler_running){
     return;
   }
 
-  while(!m_task_queue.empty()){
+  while(HasQueuedTasks() && m_state == STATE_REGISTERED){
+    delay(1);
+  }
+
+  m_state = STATE_HALT;
+  while(m_handler_running){
     delay(1);
   }
   m_webSocket.disconnect();
@@ -77,68 +193,203 @@ void LgtvControl::Disconnect(){
 void LgtvControl::CommandHandler(){
   Serial.printf("(LGTV)CommandHandler started\r\n");
 
+  bool busy = false;
+
   while(m_state != STATE_HALT){
+    if(m_state == STATE_DISCONNECTED && WiFi.status() != WL_CONNECTED){
+      // Reconnect immediately once the network is back. Attempts without network do not count.
+      m_backoff.Reset();
+      m_failed_attempts = 0;
+      m_reconnect_ms = m_backoff.Next();
+      m_webSocket.setReconnectInterval(m_reconnect_ms);
+      delay(100);
+      continue;
+    }
+
+    // WebSocketsClient reports no event for a failed connection attempt.
+    // Back off after every attempt made by loop() that did not connect.
+    const bool attempt = m_state == STATE_DISCONNECTED && millis() - m_attempt_ms >= m_reconnect_ms;
     m_webSocket.loop();
+    if(attempt && m_state == STATE_DISCONNECTED){
+      m_attempt_ms = millis();
+      m_reconnect_ms = m_backoff.Next();
+      m_webSocket.setReconnectInterval(m_reconnect_ms);
+
+      // The first attempt may still be in the WebSocket handshake, so rediscover after the second one.
+      // Discovery runs in the background once per outage. Its result comes by UpdateAddress().
+      m_failed_attempts++;
+      if(m_failed_attempts >= 2 && m_rediscover && !m_rediscover_requested){
+        m_rediscover_requested = true;
+        m_rediscover();
+      }
+    }
+    ApplyNewAddress();
+
+    DropExpiredTasks();
 
-    if(m_task_queue.empty()){
+    if(m_state == STATE_CONNECTED){
+      Register(m_clientkey);
+      busy = true;
+      continue;
+    }
+
+    TASK task;
+    if(m_state != STATE_REGISTERED || !TakeTask(task)){
+      if(busy){
+        UpdateStackHighWaterMark();
+        busy = false;
+      }
+      // A queued request shortens a long backoff so that it lands soon after the TV is back.
+      const uint32_t queued_reconnect_ms = 250;
+      if(m_state == STATE_DISCONNECTED && HasQueuedTasks() && m_reconnect_ms > queued_reconnect_ms){
+        m_reconnect_ms = queued_reconnect_ms;
+        m_webSocket.setReconnectInterval(m_reconnect_ms);
+      }
       delay(10);
       continue;
     }
 
-    TASK task = m_task_queue.front();
+    busy = true;
 
-    if(task.type == TYPE::Request && m_state != STATE_REGISTERED){
-      Serial.printf("(LGTV)Task dropped.\r\n");
-      m_task_queue.pop();
+    if(task.input != InputId::Invalid){
+      if(m_tv.inputs_known && !(m_tv.inputs & GetInputBit(task.input))){
+        Serial.printf("(LGTV)%s is not available\r\n", GetInputIdString(task.input).c_str());
+        ReportResult(task, false);
+        CompleteTask(task, false);
+        continue;
+      }
+      if(m_tv.app_known && m_tv.input == task.input){
+        Serial.printf("(LGTV)Already on %s\r\n", GetInputIdString(task.input).c_str());
+        ReportResult(task, true);
+        CompleteTask(task, false);
+        continue;
+      }
+    }
+
+    const bool answered = RunTask(task, 1000);
+    if(!answered && m_state != STATE_REGISTERED){
+      // Connection was lost. Keep the task to send it after reconnecting.
+      CompleteTask(task, true);
       continue;
     }
+    if(!answered){
+      ReportResult(task, false);
+    }
+    CompleteTask(task, false);
+  }
 
-    Serial.printf("(LGTV)Send: %s\r\n", task.message.c_str());
+  UpdateStackHighWaterMark();
+  Serial.printf("(LGTV)CommandHandler stopped\r\n");
+  m_handler_running = false;
+}
 
-    bool response_received = false;
-    m_text_cbk = [this, &task, &response_received](uint8_t * payload, size_t length){
-      DynamicJsonDocument doc(256); // TODO Check Overflow
-      deserializeJson(doc, payload);
+void LgtvControl::PushTask(const TASK & task){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  m_task_queue.push_back(task);
+  xSemaphoreGive(m_queue_mutex);
+}
 
-      if(doc["id"] != task.id){
-        return;
-      }
+bool LgtvControl::TakeTask(TASK & task){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  const bool taken = !m_task_queue.empty();
+  if(taken){
+    task = m_task_queue.front();
+    m_task_queue.pop_front();
+    m_task_running = true;
+  }
+  xSemaphoreGive(m_queue_mutex);
+  return taken;
+}
 
-      if(doc["type"] == "response"){
-        bool result = doc["payload"]["returnValue"];
-        if(!result){
-          Serial.printf("(LGTV)Command Failed\r\n");
-        }
-        if(task.type == TYPE::Request){
-          response_received = true;
-        }
-      }else if(doc["type"] == "registered"){
-        m_clientkey = doc["payload"]["client-key"].as<String>();
-        Serial.printf("(LGTV)Client Key: %s\r\n", m_clientkey.c_str());
-        m_state = STATE_REGISTERED;
-        response_received = true;
-      }
-    };
+void LgtvControl::CompleteTask(const TASK & task, bool resend){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  if(resend){
+    m_task_queue.push_front(task);
+  }
+  m_task_running = false;
+  xSemaphoreGive(m_queue_mutex);
+}
+
+void LgtvControl::DropExpiredTasks(){
+  std::vector<TASK> expired;
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  while(!m_task_queue.empty() && millis() - m_task_queue.front().queued_ms > task_expire_ms){
+    expired.push_back(m_task_queue.front());
+    m_task_queue.pop_front();
+  }
+  xSemaphoreGive(m_queue_mutex);
+
+  // The result callback may call SwitchInput(), so it is called without the lock.
+  for(const TASK & task : expired){
+    Serial.printf("(LGTV)Task expired: %s\r\n", task.message.c_str());
+    ReportResult(task, false);
+  }
+}
+
+void LgtvControl::ClearTasks(){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  m_task_queue.clear();
+  m_task_running = false;
+  xSemaphoreGive(m_queue_mutex);
+}
 
-    m_webSocket.sendTXT(task.message);
+bool LgtvControl::HasQueuedTasks(){
+  xSemaphoreTake(m_queue_mutex, portMAX_DELAY);
+  const bool queued = !m_task_queue.empty() || m_task_running;
+  xSemaphoreGive(m_queue_mutex);
+  return queued;
+}
+
+bool LgtvControl::RunTask(TASK & task, uint32_t timeout_ms){
+  Serial.printf("(LGTV)Send: %s\r\n", task.message.c_str());
 
-    uint32_t spent = 0;
-    const uint32_t timeout_ms = 1000;
-    while(!response_received){
-      m_webSocket.loop();
-      if(spent > timeout_ms){
-        break;
+  bool response_received = false;
+  m_text_cbk = [this, &task, &response_received](DynamicJsonDocument & doc){
+    if(doc["id"] != task.id){
+      return;
+    }
+
+    if(doc["type"] == "response"){
+      bool result = doc["payload"]["returnValue"];
+      if(!result){
+        Serial.printf("(LGTV)Command Failed\r\n");
+      }else if(task.input != InputId::Invalid){
+        m_tv.input = task.input;
       }
-      spent += 10;
-      delay(10);
+      ReportResult(task, result);
+      if(task.type != TYPE::Register){
+        response_received = true;
+      }
+    }else if(doc["type"] == "registered"){
+      m_clientkey = doc["payload"]["client-key"].as<String>();
+      Serial.printf("(LGTV)Client Key: %s\r\n", m_clientkey.c_str());
+      // Subscriptions are queued before any request pushed after Connect() returns.
+      Subscribe();
+      m_state = STATE_REGISTERED;
+      response_received = true;
     }
+  };
 
-    m_text_cbk = nullptr;
-    m_task_queue.pop();
+  m_webSocket.sendTXT(task.message);
 
+  uint32_t spent = 0;
+  while(!response_received && m_state != STATE_HALT){
+    m_webSocket.loop();
+    if(spent > timeout_ms){
+      break;
+    }
+    spent += 10;
+    delay(10);
   }
 
-  Serial.printf("(LGTV)CommandHandler stopped\r\n");
+  m_text_cbk = nullptr;
+  return response_received;
+}
+
+void LgtvControl::ReportResult(const TASK & task, bool success){
+  if(task.input != InputId::Invalid && m_result_callback){
+    m_result_callback(task.input, success);
+  }
 }
 
 String LgtvControl::PackSwitchInputMessage(String id, InputId inputId){
@@ -148,25 +399,49 @@ String LgtvControl::PackSwitchInputMessage(String id, InputId inputId){
 }
 
 String LgtvControl::PackRegisterMessage(String id, String clientkey){
-  DynamicJsonDocument doc(2560);
+  // json_pairing is inserted as text. Parsed into a document it needs about 3.4 KB, which
+  // overflowed the 2560 byte document and truncated the manifest.
+  DynamicJsonDocument doc(256);
   doc["id"]      = id;
   doc["type"]    = "register";
 
   if(m_clientkey.isEmpty()){
-    DynamicJsonDocument payload(2560);
-    deserializeJson(payload, json_pairing);
-    doc["payload"] = payload;
-  }else{
-    DynamicJsonDocument payload(128);
-    payload["client-key"] = m_clientkey;
-    doc["payload"] = payload;
+    String register_msg;
+    serializeJson(doc, register_msg);
+    register_msg.remove(register_msg.length() - 1);
+    register_msg += String(",\"payload\":") + json_pairing + String("}");
+    return register_msg;
   }
 
+  doc["payload"]["client-key"] = m_clientkey;
+
   String register_msg;
   serializeJson(doc, register_msg);
   return register_msg;
 }
 
+String LgtvControl::PackRequestMessage(String id, URI uri){
+  DynamicJsonDocument doc(256);
+  doc["id"]      = id;
+  doc["type"]    = "request";
+  doc["uri"]     = GetUriString(uri);
+
+  String request_msg;
+  serializeJson(doc, request_msg);
+  return request_msg;
+}
+
+String LgtvControl::PackSubscribeMessage(String id, URI uri){
+  DynamicJsonDocument doc(256);
+  doc["id"]      = id;
+  doc["type"]    = "subscribe";
+  doc["uri"]     = GetUriString(uri);
+
+  String subscribe_msg;
+  serializeJson(doc, subscribe_msg);
+  return subscribe_msg;
+}
+
 String LgtvControl::PackRequestMessage(String id, URI uri, DynamicJsonDocument & payload){
   DynamicJsonDocument doc(256);
   doc["id"]      = id;
@@ -183,20 +458,27 @@ void LgtvControl::WebSocketEventHandler(WStype_t type, uint8_t * payload, size_t
   switch(type) {
     case WStype_CONNECTED:
       Serial.printf("(LGTV)Connected\r\n");
+      m_backoff.Reset();
+      m_failed_attempts = 0;
+      m_rediscover_requested = false;
       m_state = STATE_CONNECTED;
-      Register(m_clientkey);
       break;
 
     case WStype_TEXT:
       Serial.printf("(LGTV)Recv: %s\r\n", payload);
-      if(m_text_cbk){
-        m_text_cbk(payload, length);
-      }
+      TextHandler(payload, length);
       break;
 
     case WStype_DISCONNECTED:
       Serial.printf("(LGTV)Disconnected\r\n");
-      m_state = STATE_HALT;
+      m_tv.app_known = false;
+      m_tv.audio_known = false;
+      if(m_state != STATE_HALT){
+        m_state = STATE_DISCONNECTED;
+        m_attempt_ms = millis();
+        m_reconnect_ms = m_backoff.Next();
+        m_webSocket.setReconnectInterval(m_reconnect_ms);
+      }
       break;
 
     default:
@@ -204,18 +486,115 @@ void LgtvControl::WebSocketEventHandler(WStype_t type, uint8_t * payload, size_t
   }
 }
 
+void LgtvControl::TextHandler(uint8_t * payload, size_t length){
+  DynamicJsonDocument doc(1024);
+  DeserializationError error = deserializeJson(doc, (const char *)payload, length, DeserializationOption::Filter(GetTextFilter()));
+  if(error){
+    Serial.printf("(LGTV)Invalid message: %s\r\n", error.c_str());
+    return;
+  }
+
+  UpdateState(doc);
+
+  if(m_text_cbk){
+    m_text_cbk(doc);
+  }
+}
+
+void LgtvControl::UpdateState(DynamicJsonDocument & doc){
+  if(doc["type"] != "response"){
+    return;
+  }
+
+  const String id = doc["id"].as<String>();
+  JsonObject payload = doc["payload"];
+  if(id.isEmpty() || payload.isNull()){
+    return;
+  }
+
+  if(id == m_app_sub_id){
+    if(!payload.containsKey("appId")){
+      return;
+    }
+    m_tv.input = FindInputId(APPID_LIST, payload["appId"].as<String>());
+    m_tv.app_known = true;
+  }else if(id == m_audio_sub_id){
+    JsonObject status = payload["volumeStatus"];
+    if(!status.isNull()){
+      m_tv.volume = status["volume"];
+      m_tv.mute   = status["muteStatus"];
+    }else if(payload.containsKey("volume")){
+      m_tv.volume = payload["volume"];
+      m_tv.mute   = payload["mute"];
+    }else{
+      return;
+    }
+    m_tv.audio_known = true;
+  }else if(id == m_inputs_req_id){
+    JsonArray devices = payload["devices"];
+    if(devices.isNull()){
+      return;
+    }
+    uint8_t inputs = 0;
+    for(JsonObject device : devices){
+      inputs |= GetInputBit(FindInputId(INPUTID_LIST, device["id"].as<String>()));
+    }
+    // A list without any HDMI input is not trusted, since every SwitchInput would be rejected.
+    if(inputs == 0){
+      Serial.printf("(LGTV)No known input in the external input list\r\n");
+      return;
+    }
+    m_tv.inputs = inputs;
+    m_tv.inputs_known = true;
+  }
+}
+
+void LgtvControl::Subscribe(){
+  m_app_sub_id = IncrementId();
+  PushTask(TASK(m_app_sub_id, TYPE::Subscribe, PackSubscribeMessage(m_app_sub_id, URI::GetForegroundAppInfo)));
+
+  m_audio_sub_id = IncrementId();
+  PushTask(TASK(m_audio_sub_id, TYPE::Subscribe, PackSubscribeMessage(m_audio_sub_id, URI::GetAudioStatus)));
+
+  if(!m_tv.inputs_known){
+    m_inputs_req_id = IncrementId();
+    PushTask(TASK(m_inputs_req_id, TYPE::Request, PackRequestMessage(m_inputs_req_id, URI::GetExternalInputList)));
+  }
+}
+
 void LgtvControl::Register(String clientkey){
   String id = IncrementId();
   String msg = PackRegisterMessage(id, clientkey);
   TASK task(id, TYPE::Register, msg);
-  m_task_queue.push(task);
+
+  // Pairing waits for the user to accept the dialog on the TV.
+  const uint32_t timeout_ms = clientkey.isEmpty() ? 60000 : 3000;
+  if(!RunTask(task, timeout_ms) && m_state == STATE_CONNECTED){
+    Serial.printf("(LGTV)Registration failed\r\n");
+    m_webSocket.disconnect();
+  }
 }
 
-void LgtvControl::SwitchInput(InputId inputId){
+bool LgtvControl::SwitchInput(InputId inputId){
+  if(inputId == InputId::Invalid){
+    return false;
+  }
+
+  if(m_tv.inputs_known && !(m_tv.inputs & GetInputBit(inputId))){
+    Serial.printf("(LGTV)%s is not available\r\n", GetInputIdString(inputId).c_str());
+    return false;
+  }
+
+  // Nothing is pending, so the cached input is what the TV shows now.
+  if(m_state == STATE_REGISTERED && m_tv.app_known && m_tv.input == inputId && !HasQueuedTasks()){
+    Serial.printf("(LGTV)Already on %s\r\n", GetInputIdString(inputId).c_str());
+    return true;
+  }
+
   String id = IncrementId();
   String msg = PackSwitchInputMessage(id, inputId);
-  TASK task(id, TYPE::Request, msg);
-  m_task_queue.push(task);
+  PushTask(TASK(id, TYPE::Request, msg, inputId));
+  return true;
 }
 
 String LgtvControl::IncrementId(){
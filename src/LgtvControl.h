@@ -9,6 +9,7 @@
 //   lc.Connect(lgtv);
 // 3. Call APIs
 //   lc.SwitchInput(LgtvControl::InputId::HDMI1);
+//   lc.GetState().volume;
 // 4. Disconnect
 //   lc.Disconnect();
 // 5. Reconnect
@@ -18,13 +19,23 @@
 // LgtvControl does not support all commands.
 // Error handling is incomplete. Some APIs could get stuck.
 // ClientKey should be stored into non-volatile memory and reuse it.
+// After Connect(), the WebSocket is pinged while idle and reconnected in the background with
+// jittered exponential backoff. Requests are kept in the queue while reconnecting and are
+// dropped if they wait longer than task_expire_ms.
+// After registration, LgtvControl subscribes to the foreground app and the audio status
+// and fetches the external input list once. These are cached in TvState so that
+// SwitchInput() to the current input completes without sending anything.
+
+#pragma once
 
 #include <WiFi.h>
 #include <functional>
 #include <ArduinoJson.h>
-#include <queue>
+#include <deque>
+#include <vector>
 #include <unordered_map>
 #include <WebSocketsClient.h>
+#include "Backoff.h"
 
 class LgtvControl {
 public:
@@ -32,13 +43,27 @@ public:
     HDMI1,
     HDMI2,
     HDMI3,
-    HDMI4
+    HDMI4,
+    Invalid
+  };
+
+  // TvState is updated by subscription messages while connected.
+  // *_known flags are false until the TV reports the corresponding value.
+  struct TvState {
+    bool    app_known    = false;
+    InputId input        = InputId::Invalid; // Invalid if the foreground app is not an HDMI input
+    bool    inputs_known = false;
+    uint8_t inputs       = 0;                // bit n is set if InputId(n) is available
+    bool    audio_known  = false;
+    bool    mute         = false;
+    uint8_t volume       = 0;
   };
 
   LgtvControl();
   ~LgtvControl();
 
   // Connect() might spend much time.
+  // It keeps trying in the background after returning false, until Disconnect() is called.
   // @return true if succeeded. false if not.
   bool Connect(const IPAddress lgtv, String clientkey = "");
 
@@ -47,7 +72,34 @@ public:
   void Disconnect();
 
   // SwitchInput() pushes a task to switch input. It returns before the task completes.
-  void SwitchInput(InputId inputId);
+  // It returns immediately without pushing a task if the TV is already on inputId.
+  // @return false if the TV does not have inputId.
+  bool SwitchInput(InputId inputId);
+
+  // @return true if registered and ready to accept requests.
+  bool IsRegistered();
+
+  // @return true from Connect() until Disconnect(). Requests are accepted even while reconnecting.
+  bool IsStarted();
+
+  const TvState & GetState();
+
+  // @return minimum free stack of CommandHandler tasks in bytes. 0 if not measured yet.
+  uint32_t GetStackHighWaterMark();
+
+  // rediscover is called by CommandHandler when reconnecting keeps failing, once until the TV
+  // is connected again. It must not block. It starts finding the TV and reports by UpdateAddress().
+  void SetRediscoverCallback(std::function<void()> rediscover);
+
+  // UpdateAddress() gives the current address of the TV. It may be called from any task.
+  // CommandHandler switches to a changed address while disconnected. 0.0.0.0 is ignored.
+  void UpdateAddress(IPAddress address);
+
+  // result_callback is called once for each request pushed by SwitchInput(): with true when the TV
+  // accepts it or is already on the input, and with false when the TV refuses it, does not answer
+  // or the request is dropped. It is called from CommandHandler.
+  // A SwitchInput() that returns without pushing a request is not reported.
+  void SetResultCallback(std::function<void(InputId, bool)> result_callback);
 
   // Application may read client key to reuse it.
   String GetClientKey();
@@ -58,25 +110,40 @@ public:
 private:
   enum class TYPE {
     Register,
-    Request
+    Request,
+    Subscribe
   };
 
   enum class URI {
-    SwitchInput
+    SwitchInput,
+    GetExternalInputList,
+    GetForegroundAppInfo,
+    GetAudioStatus
   };
   
   const std::unordered_map<LgtvControl::URI, String> URI_LIST = {
-    { LgtvControl::URI::SwitchInput, String("ssap://tv/switchInput") }
+    { LgtvControl::URI::SwitchInput,          String("ssap://tv/switchInput") },
+    { LgtvControl::URI::GetExternalInputList, String("ssap://tv/getExternalInputList") },
+    { LgtvControl::URI::GetForegroundAppInfo, String("ssap://com.webos.applicationManager/getForegroundAppInfo") },
+    { LgtvControl::URI::GetAudioStatus,       String("ssap://audio/getStatus") }
   };
   String GetUriString(LgtvControl::URI uri){
     return URI_LIST.count(uri) > 0 ? URI_LIST.at(uri) : String();
   }
 
+  // Register() sends the register message and waits for the result.
   void Register(String clientkey);
+  void Subscribe();
   void WebSocketEventHandler(WStype_t type, uint8_t * payload, size_t length);
+  void TextHandler(uint8_t * payload, size_t length);
+
+  // UpdateState() updates m_tv if doc is a response to a subscription or to the input list request.
+  void UpdateState(DynamicJsonDocument & doc);
 
   String PackRegisterMessage(String id, String clientkey);
   String PackRequestMessage(String id, URI uri, DynamicJsonDocument & payload);
+  String PackRequestMessage(String id, URI uri);
+  String PackSubscribeMessage(String id, URI uri);
   String PackSwitchInputMessage(String id, InputId inputId);
 
   String IncrementId();
@@ -84,9 +151,13 @@ private:
 
 // data
   const uint16_t lgtvport = 3000;
+  const uint32_t ping_interval_ms = 5000;
+  const uint32_t pong_timeout_ms = 2000;
+  const uint8_t pong_missing_count = 2;
+  const uint32_t task_expire_ms = 10000;
 
   WebSocketsClient m_webSocket;
-  std::function<void(uint8_t * payload, size_t length)> m_text_cbk = nullptr;
+  std::function<void(DynamicJsonDocument & doc)> m_text_cbk = nullptr;
   String m_clientkey;
   String m_id = "abcdef000000";
 
@@ -99,18 +170,77 @@ private:
 
   STATE m_state = STATE_DISCONNECTED;
 
+  IPAddress m_lgtv;
+  TvState m_tv;
+  String m_app_sub_id;
+  String m_audio_sub_id;
+  String m_inputs_req_id;
+
   struct TASK {
     String id;
     TYPE type;
     String message;
+    InputId input; // target of SwitchInput, Invalid for others
+    uint32_t queued_ms;
 
-    TASK(String id_in, TYPE type_in, String message_in){
+    TASK(){
+      type = TYPE::Request;
+      input = InputId::Invalid;
+      queued_ms = 0;
+    }
+
+    TASK(String id_in, TYPE type_in, String message_in, InputId input_in = InputId::Invalid){
       id = id_in;
       type = type_in;
       message = message_in;
+      input = input_in;
+      queued_ms = millis();
     }
   };
 
-  std::queue<TASK> m_task_queue;
-};
+  // UpdateStackHighWaterMark() is called by CommandHandler after it becomes idle.
+  void UpdateStackHighWaterMark();
+
+  // ApplyNewAddress() switches to the address given by UpdateAddress() if it changed.
+  void ApplyNewAddress();
+
+  // RunTask() sends the message of task and waits for its response.
+  // @return true if the response is received.
+  bool RunTask(TASK & task, uint32_t timeout_ms);
+
+  // ReportResult() passes the result of a SwitchInput task to m_result_callback.
+  void ReportResult(const TASK & task, bool success);
+
+  // m_task_queue is shared with the callers of SwitchInput() and is accessed under m_queue_mutex only.
+  void PushTask(const TASK & task);
 
+  // TakeTask() removes the first task from the queue and marks it running until CompleteTask().
+  // @return false if the queue is empty.
+  bool TakeTask(TASK & task);
+
+  // CompleteTask() ends the running task. With resend, it goes back to the front of the queue.
+  void CompleteTask(const TASK & task, bool resend);
+
+  void DropExpiredTasks();
+  void ClearTasks();
+
+  // @return true if a task is queued or running.
+  bool HasQueuedTasks();
+
+  SemaphoreHandle_t m_queue_mutex = nullptr;
+  std::deque<TASK> m_task_queue;
+  bool m_task_running = false;         // true from TakeTask() until CompleteTask()
+  volatile bool m_handler_running = false;
+  Backoff m_backoff = Backoff(250, 30000);
+  uint32_t m_reconnect_ms = 0;
+  uint32_t m_attempt_ms = 0;
+  uint32_t m_failed_attempts = 0;      // attempts that did not connect since the last connection
+  std::function<void(InputId, bool)> m_result_callback = nullptr;
+  std::function<void()> m_rediscover = nullptr;
+  bool m_rediscover_requested = false; // true after m_rediscover was called in this outage
+  volatile uint32_t m_new_address = 0; // set by UpdateAddress() and taken by ApplyNewAddress()
+  volatile uint32_t m_stack_high_water = 0;
+
+  // LgtvControlProbe gives the native tests in test/ access to the message handlers, the builders and the cached state.
+  friend class LgtvControlProbe;
+};
@@ -0,0 +1,83 @@
+#include "Macros.h"
+
+Macros::Macros(HeosControl & hc, LgtvControl & lc) : m_hc(hc), m_lc(lc){
+}
+
+Macros::~Macros(){
+}
+
+void Macros::SetConnectCallbacks(std::function<bool()> connect_heos, std::function<bool()> connect_lgtv){
+  m_connect_heos = connect_heos;
+  m_connect_lgtv = connect_lgtv;
+}
+
+bool Macros::Run(MACRO macro){
+  switch(macro){
+    case MACRO::HeosVolume:
+    {
+      if(!ConnectHeos()){
+        return false;
+      }
+      return m_hc.SetVolume(20);
+    }
+    case MACRO::HeosUsbDac:
+    {
+      if(!ConnectHeos()){
+        return false;
+      }
+      return RunScene(HeosControl::INPUT_SOURCE::USBDAC, 25);
+    }
+    case MACRO::HeosOptical:
+    {
+      if(!ConnectHeos()){
+        return false;
+      }
+      return RunScene(HeosControl::INPUT_SOURCE::OPTICAL_IN_1, 30);
+    }
+    case MACRO::TvHdmi1:
+    {
+      if(!ConnectLgtv()){
+        return false;
+      }
+      return m_lc.SwitchInput(LgtvControl::InputId::HDMI1);
+    }
+    case MACRO::TvHdmi2:
+    {
+      if(!ConnectLgtv()){
+        return false;
+      }
+      return m_lc.SwitchInput(LgtvControl::InputId::HDMI2);
+    }
+    case MACRO::TvHdmi3:
+    {
+      if(!ConnectLgtv()){
+        return false;
+      }
+      return m_lc.SwitchInput(LgtvControl::InputId::HDMI3);
+    }
+    case MACRO::TvHdmi4:
+    {
+      if(!ConnectLgtv()){
+        return false;
+      }
+      return m_lc.SwitchInput(LgtvControl::InputId::HDMI4);
+    }
+    default:
+      return false;
+  }
+}
+
+bool Macros::ConnectHeos(){
+  return m_connect_heos ? m_connect_heos() : m_hc.IsStarted();
+}
+
+bool Macros::ConnectLgtv(){
+  return m_connect_lgtv ? m_connect_lgtv() : m_lc.IsStarted();
+}
+
+bool Macros::RunScene(HeosControl::INPUT_SOURCE input, unsigned int level){
+  m_hc.BeginBatch();
+  m_hc.PlayInputSource(input);
+  m_hc.SetVolume(level);
+  return m_hc.Commit();
+}
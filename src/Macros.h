@@ -0,0 +1,54 @@
+// Macros class runs the command sequences assigned to the buttons.
+//
+// Usage:
+// 1. Create an Instance with the controllers
+//   Macros macros(hc, lc);
+// 2. Give how to reach each device
+//   macros.SetConnectCallbacks(connectHeos, connectLgtv);
+// 3. Run a macro
+//   macros.Run(Macros::MACRO::HeosUsbDac);
+//
+// Note:
+// A connect callback is called before every macro of its device and returns false if the
+// device cannot be reached. Without callbacks, a macro runs only if its controller is started.
+// Run() returns when the commands are queued. Results come by the result callbacks of the controllers.
+
+#pragma once
+
+#include <functional>
+#include "HeosControl.h"
+#include "LgtvControl.h"
+
+class Macros {
+public:
+  enum class MACRO {
+    HeosVolume,  // volume 20
+    HeosUsbDac,  // USB DAC at volume 25
+    HeosOptical, // optical in 1 at volume 30
+    TvHdmi1,
+    TvHdmi2,
+    TvHdmi3,
+    TvHdmi4,
+    Invalid
+  };
+
+  Macros(HeosControl & hc, LgtvControl & lc);
+  ~Macros();
+
+  void SetConnectCallbacks(std::function<bool()> connect_heos, std::function<bool()> connect_lgtv);
+
+  /// @return true if the commands of macro were queued.
+  bool Run(MACRO macro);
+
+private:
+  bool ConnectHeos();
+  bool ConnectLgtv();
+
+  /// RunScene switches the HEOS input and sets the volume in one batch.
+  bool RunScene(HeosControl::INPUT_SOURCE input, unsigned int level);
+
+  HeosControl & m_hc;
+  LgtvControl & m_lc;
+  std::function<bool()> m_connect_heos = nullptr;
+  std::function<bool()> m_connect_lgtv = nullptr;
+};
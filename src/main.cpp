@@ -4,11 +4,30 @@
 //         [10][ 9][ 8]
 // [ 5][ 6][ 7][21][20]
 
+// Boot pipeline:
+// 1. Buttons are armed before WiFi starts.
+// 2. When WiFi gets an IP address, HEOS and LGTV connections are pre-warmed in parallel tasks.
+//    Controllers that are already started are left to reconnect by themselves.
+// 3. Button presses wait for the pre-warm of the device they control, then reuse the connection.
+// g_boot records when each stage is reached. It is printed when a device confirms the first command.
+// Sending 'd' on the serial monitor prints heap counters and task stack high-water marks, and checks
+// their drift against limits. The heap baseline is taken at the first response.
+// Device addresses found by SSDP are cached in non-volatile memory. Cached addresses are tried first
+// and SSDP runs again only when connecting fails.
+
 #include <WiFi.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "HeosControl.h"
 #include "LgtvControl.h"
+#include "BootTimeline.h"
+#include "Diagnostics.h"
+#include "DeviceDiscovery.h"
+#include "Macros.h"
 
-// Please modify ssid, password, heosdevice and lgtv.
+// Please modify ssid and password.
+// heosdevice and lgtv are used only until SSDP discovery finds the devices.
 const char* ssid     = "SSID";
 const char* password = "PASSWORD";
 const IPAddress heosdevice(192,168,1,40);
@@ -16,10 +35,174 @@ const IPAddress lgtv(192,168,1,41);
 
 HeosControl hc;
 LgtvControl lc;
+BootTimeline g_boot;
+Diagnostics g_diag;
+DeviceDiscovery g_discovery;
+Macros g_macros(hc, lc);
 
 volatile int g_macroId = 0; // 0 : invalid
 String g_clientkey = "";
 
+EventGroupHandle_t g_prewarm_events = nullptr;
+const EventBits_t PREWARM_HEOS_DONE = BIT0;
+const EventBits_t PREWARM_LGTV_DONE = BIT1;
+const EventBits_t PREWARM_HEOS_RUNNING = BIT2;
+const EventBits_t PREWARM_LGTV_RUNNING = BIT3;
+const uint32_t prewarm_timeout_ms = 10000;
+
+IPAddress getAddress(DeviceDiscovery::DEVICE device, IPAddress fallback){
+  const IPAddress address = g_discovery.GetAddress(device);
+  return (uint32_t)address != 0 ? address : fallback;
+}
+
+IPAddress rediscover(DeviceDiscovery::DEVICE device){
+  g_discovery.Discover(device);
+  return g_discovery.GetAddress(device);
+}
+
+bool startHeos(){
+  const IPAddress address = getAddress(DeviceDiscovery::DEVICE::Heos, heosdevice);
+  if(hc.Connect(address, true)){
+    return true;
+  }
+
+  // The address may have been reassigned by DHCP.
+  const IPAddress found = rediscover(DeviceDiscovery::DEVICE::Heos);
+  if((uint32_t)found == 0 || (uint32_t)found == (uint32_t)address){
+    return false;
+  }
+  return hc.Connect(found, false);
+}
+
+// The client key is empty until the TV is paired.
+void storeClientKey(){
+  const String clientkey = lc.GetClientKey();
+  if(!clientkey.isEmpty()){
+    g_clientkey = clientkey;
+  }
+}
+
+// LgtvControl keeps trying in the background after Connect() fails. It rediscovers the TV itself.
+bool startLgtv(){
+  if(!lc.Connect(getAddress(DeviceDiscovery::DEVICE::Lgtv, lgtv), g_clientkey)){
+    return false;
+  }
+  storeClientKey();
+  return true;
+}
+
+void prewarmHeos(void *){
+  if(startHeos()){
+    g_boot.Mark(BootTimeline::STAGE::HeosReady);
+  }else{
+    Serial.printf("(HEOS)Pre-warm failed\r\n");
+  }
+  xEventGroupClearBits(g_prewarm_events, PREWARM_HEOS_RUNNING);
+  xEventGroupSetBits(g_prewarm_events, PREWARM_HEOS_DONE);
+  vTaskDelete(NULL);
+}
+
+void prewarmLgtv(void *){
+  if(startLgtv()){
+    g_boot.Mark(BootTimeline::STAGE::LgtvReady);
+  }else{
+    Serial.printf("(LGTV)Pre-warm failed\r\n");
+  }
+  xEventGroupClearBits(g_prewarm_events, PREWARM_LGTV_RUNNING);
+  xEventGroupSetBits(g_prewarm_events, PREWARM_LGTV_DONE);
+  vTaskDelete(NULL);
+}
+
+void onWiFiGotIp(WiFiEvent_t event, WiFiEventInfo_t info){
+  g_boot.Mark(BootTimeline::STAGE::WifiConnected);
+  Serial.print("WiFi connected\r\n");
+
+  // After WiFi comes back, started controllers reconnect by themselves. Connect() again would
+  // drop their queued commands and cached state. A pre-warm still running is not repeated.
+  const EventBits_t bits = xEventGroupGetBits(g_prewarm_events);
+  if(!hc.IsStarted() && !(bits & PREWARM_HEOS_RUNNING)){
+    xEventGroupClearBits(g_prewarm_events, PREWARM_HEOS_DONE);
+    xEventGroupSetBits(g_prewarm_events, PREWARM_HEOS_RUNNING);
+    xTaskCreatePinnedToCore(prewarmHeos, "prewarmHeos", 6144, nullptr, 1, nullptr, 0);
+  }
+  if(!lc.IsStarted() && !(bits & PREWARM_LGTV_RUNNING)){
+    xEventGroupClearBits(g_prewarm_events, PREWARM_LGTV_DONE);
+    xEventGroupSetBits(g_prewarm_events, PREWARM_LGTV_RUNNING);
+    xTaskCreatePinnedToCore(prewarmLgtv, "prewarmLgtv", 6144, nullptr, 1, nullptr, 0);
+  }
+}
+
+// Wait for the pre-warm so that a press during boot does not connect twice.
+bool waitPrewarm(EventBits_t bit){
+  const EventBits_t bits = xEventGroupWaitBits(g_prewarm_events, bit, pdFALSE, pdTRUE, pdMS_TO_TICKS(prewarm_timeout_ms));
+  return (bits & bit) != 0;
+}
+
+// The HEOS connection is kept open so that presses do not pay for connect and get_players.
+// Commands are queued while HeosControl reconnects in the background.
+bool connectHeos(){
+  if(!waitPrewarm(PREWARM_HEOS_DONE)){
+    Serial.printf("(HEOS)Not ready\r\n");
+    return false;
+  }
+  if(hc.IsStarted()){
+    return true;
+  }
+  if(!startHeos()){
+    Serial.printf("(HEOS)Connection failed\r\n");
+    return false;
+  }
+  return true;
+}
+
+// The TV connection is kept open so that LgtvControl can keep its cached state.
+// Requests are queued while LgtvControl reconnects in the background.
+bool connectLgtv(){
+  if(!waitPrewarm(PREWARM_LGTV_DONE)){
+    Serial.printf("(LGTV)Not ready\r\n");
+    return false;
+  }
+  if(lc.IsStarted()){
+    return true;
+  }
+  if(!startLgtv()){
+    Serial.printf("(LGTV)Connection failed\r\n");
+    return false;
+  }
+  return true;
+}
+
+void commandSent(bool result){
+  if(result){
+    g_boot.Mark(BootTimeline::STAGE::FirstCommand);
+  }
+}
+
+// Called from the CommandHandler tasks when a device answers a command.
+void commandAnswered(bool success){
+  if(success && g_boot.Mark(BootTimeline::STAGE::FirstResponse)){
+    g_boot.Print();
+    g_diag.Sample();
+  }
+}
+
+// Drift from the baseline that the 'd' command reports as a problem.
+Diagnostics::LIMITS getDiagnosticsLimits(){
+  Diagnostics::LIMITS limits;
+  limits.heap_allocated_growth = 2048;
+  limits.largest_free_block_loss = 8192;
+  limits.allocated_blocks_growth = 16;
+  limits.stack_high_water_loss = 512;
+  return limits;
+}
+
+void printDiagnostics(){
+  g_diag.Print();
+  if(g_diag.Check(getDiagnosticsLimits())){
+    Serial.printf("(DIAG)Within limits\r\n");
+  }
+}
+
 void macro1(){ g_macroId = 1; }
 void macro2(){ g_macroId = 2; }
 void macro3(){ g_macroId = 3; }
@@ -31,11 +214,6 @@ void macro8(){ g_macroId = 8; }
 
 void setup() {
   Serial.begin(115200);
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-  }
-  Serial.print("WiFi connected\r\n");
 
   pinMode(10, INPUT_PULLUP);
   pinMode( 9, INPUT_PULLUP);
@@ -55,93 +233,54 @@ void setup() {
   attachInterrupt(digitalPinToInterrupt( 7), macro6, ONLOW);
   attachInterrupt(digitalPinToInterrupt(21), macro7, ONLOW);
   attachInterrupt(digitalPinToInterrupt(20), macro8, ONLOW);
+  g_boot.Mark(BootTimeline::STAGE::ButtonsArmed);
+  g_macros.SetConnectCallbacks(connectHeos, connectLgtv);
+
+  // setup() runs in the loop task.
+  const TaskHandle_t loop_task = xTaskGetCurrentTaskHandle();
+  g_diag.AddStack("HeosControl", [](){ return hc.GetStackHighWaterMark(); });
+  g_diag.AddStack("LgtvControl", [](){ return lc.GetStackHighWaterMark(); });
+  g_diag.AddStack("loop", [loop_task](){ return (uint32_t)uxTaskGetStackHighWaterMark(loop_task); });
+
+  // get_players sent by Connect() is not a press.
+  hc.SetResultCallback([](HeosControl::COMMAND cmd, bool success){
+    if(cmd != HeosControl::COMMAND::GetPlayers){
+      commandAnswered(success);
+    }
+  });
+  // Pairing may finish in the background after Connect() gave up, e.g. while the dialog on the TV
+  // waits for the user. The TV answers requests only after registration, so the key is known then.
+  lc.SetResultCallback([](LgtvControl::InputId input, bool success){
+    storeClientKey();
+    commandAnswered(success);
+  });
 
+  g_discovery.Begin();
+  // The controllers keep serving their connections while SSDP runs in its own task.
+  hc.SetRediscoverCallback([](){
+    g_discovery.DiscoverAsync(DeviceDiscovery::DEVICE::Heos, [](IPAddress address){ hc.UpdateAddress(address); });
+  });
+  lc.SetRediscoverCallback([](){
+    g_discovery.DiscoverAsync(DeviceDiscovery::DEVICE::Lgtv, [](IPAddress address){ lc.UpdateAddress(address); });
+  });
+
+  g_prewarm_events = xEventGroupCreate();
+  WiFi.onEvent(onWiFiGotIp, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+  WiFi.begin(ssid, password);
 }
 
 void loop() {
+  // Diagnostics are asked from the serial monitor so that every button stays free for a macro.
+  if(Serial.available() > 0 && Serial.read() == 'd'){
+    printDiagnostics();
+  }
+
   if(g_macroId == 0){
     return;
   }
 
-  switch(g_macroId){
-    case 1:
-    {
-      if(!hc.Connect(heosdevice, true)){
-        Serial.printf("(HEOS)Connection failed\r\n");
-        break;
-      }
-      hc.SetVolume(20);
-      hc.Disconnect();
-      break;
-    }
-    case 2:
-    {
-      if(!hc.Connect(heosdevice, true)){
-        Serial.printf("(HEOS)Connection failed\r\n");
-        break;
-      }
-      hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
-      hc.SetVolume(25);
-      hc.Disconnect();
-      break;
-    }
-    case 3:
-    {
-      if(!hc.Connect(heosdevice, true)){
-        Serial.printf("(HEOS)Connection failed\r\n");
-        break;
-      }
-      hc.PlayInputSource(HeosControl::INPUT_SOURCE::OPTICAL_IN_1);
-      hc.SetVolume(30);
-      hc.Disconnect();
-      break;
-    }
-    case 4:
-    {
-      if(!lc.Connect(lgtv, g_clientkey)){
-        Serial.printf("(LGTV)Connection failed\r\n");
-        break;
-      }
-      lc.SwitchInput(LgtvControl::InputId::HDMI1);
-      g_clientkey = lc.GetClientKey();
-      lc.Disconnect();
-      break;
-    }
-    case 5:
-    {
-      if(!lc.Connect(lgtv, g_clientkey)){
-        Serial.printf("(LGTV)Connection failed\r\n");
-        break;
-      }
-      lc.SwitchInput(LgtvControl::InputId::HDMI2);
-      g_clientkey = lc.GetClientKey();
-      lc.Disconnect();
-      break;
-    }
-    case 6:
-    {
-      if(!lc.Connect(lgtv, g_clientkey)){
-        Serial.printf("(LGTV)Connection failed\r\n");
-        break;
-      }
-      lc.SwitchInput(LgtvControl::InputId::HDMI3);
-      g_clientkey = lc.GetClientKey();
-      lc.Disconnect();
-      break;
-    }
-    case 7:
-    {
-      if(!lc.Connect(lgtv, g_clientkey)){
-        Serial.printf("(LGTV)Connection failed\r\n");
-        break;
-      }
-      lc.SwitchInput(LgtvControl::InputId::HDMI4);
-      g_clientkey = lc.GetClientKey();
-      lc.Disconnect();
-      break;
-    }
-    default: break;
-  }
+  // Buttons 1 to 7 run macros. Button 8 has no macro assigned.
+  commandSent(g_macros.Run((Macros::MACRO)(g_macroId - 1)));
 
   delay(100);
   g_macroId = 0;
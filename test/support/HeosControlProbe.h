@@ -0,0 +1,60 @@
+// HeosControlProbe reaches the private members of HeosControl for the native tests.
+//
+// Usage:
+//   HeosControl hc;
+//   HeosControlProbe probe(hc);
+//   probe.Attach(IPAddress(192,168,1,40));   // CLI socket without CommandHandler
+//   String line = probe.WaitJsonResponse(100);
+//
+// Note:
+// Attach() connects the socket only, so the test task owns it. Do not mix it with Connect().
+
+#pragma once
+
+#include "HeosControl.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+class HeosControlProbe {
+public:
+  typedef HeosControl::MESSAGE MESSAGE;
+
+  explicit HeosControlProbe(HeosControl & hc) : m_hc(hc) {}
+
+  bool Attach(IPAddress address, uint16_t port = 1255){
+    return m_hc.m_self.connect(address, port) == 1;
+  }
+
+  void Detach(){
+    m_hc.m_self.stop();
+  }
+
+  String WaitJsonResponse(uint32_t timeout_ms){
+    return m_hc.WaitJsonResponse(timeout_ms);
+  }
+
+  MESSAGE ParseMessage(const String & line, DynamicJsonDocument & doc){
+    return m_hc.ParseMessage(line, doc);
+  }
+
+  static size_t GetDocumentCapacity(const String & json){
+    return HeosControl::GetDocumentCapacity(json);
+  }
+
+  void RouteMessage(const String & line){
+    m_hc.RouteMessage(line);
+  }
+
+  void ClearQueue(){
+    xSemaphoreTake(m_hc.m_queue_mutex, portMAX_DELAY);
+    m_hc.m_task_queue.clear();
+    xSemaphoreGive(m_hc.m_queue_mutex);
+  }
+
+  void SetPlayerId(long pid){
+    m_hc.m_pid = pid;
+  }
+
+private:
+  HeosControl & m_hc;
+};
@@ -0,0 +1,72 @@
+// LgtvControlProbe reaches the private members of LgtvControl for the native tests.
+//
+// Usage:
+//   LgtvControl lc;
+//   LgtvControlProbe probe(lc);
+//   probe.SetSubscriptionIds("abcdef100002", "abcdef100003", "abcdef100004");
+//   probe.TextHandler(frame, length);
+//   lc.GetState().input;
+//
+// Note:
+// TextHandler() passes a copy of the frame without a terminating NUL, so a handler that reads
+// past length reads outside the buffer.
+
+#pragma once
+
+#include <vector>
+#include "LgtvControl.h"
+
+class LgtvControlProbe {
+public:
+  typedef LgtvControl::URI URI;
+  typedef LgtvControl::InputId InputId;
+
+  explicit LgtvControlProbe(LgtvControl & lc) : m_lc(lc) {}
+
+  void TextHandler(const char * payload, size_t length){
+    std::vector<uint8_t> buffer(payload, payload + length);
+    m_lc.TextHandler(buffer.data(), length);
+  }
+
+  void WebSocketEvent(WStype_t type, const char * payload = ""){
+    std::vector<uint8_t> buffer(payload, payload + strlen(payload) + 1);
+    m_lc.WebSocketEventHandler(type, buffer.data(), strlen(payload));
+  }
+
+  void UpdateState(DynamicJsonDocument & doc){
+    m_lc.UpdateState(doc);
+  }
+
+  void SetSubscriptionIds(const String & app_sub_id, const String & audio_sub_id, const String & inputs_req_id){
+    m_lc.m_app_sub_id = app_sub_id;
+    m_lc.m_audio_sub_id = audio_sub_id;
+    m_lc.m_inputs_req_id = inputs_req_id;
+  }
+
+  void SetClientKey(const String & clientkey){
+    m_lc.m_clientkey = clientkey;
+  }
+
+  void ResetState(){
+    m_lc.m_tv = LgtvControl::TvState();
+  }
+
+  String PackRegisterMessage(const String & id, const String & clientkey){
+    return m_lc.PackRegisterMessage(id, clientkey);
+  }
+
+  String PackRequestMessage(const String & id, URI uri){
+    return m_lc.PackRequestMessage(id, uri);
+  }
+
+  String PackSubscribeMessage(const String & id, URI uri){
+    return m_lc.PackSubscribeMessage(id, uri);
+  }
+
+  String PackSwitchInputMessage(const String & id, InputId inputId){
+    return m_lc.PackSwitchInputMessage(id, inputId);
+  }
+
+private:
+  LgtvControl & m_lc;
+};
@@ -0,0 +1,193 @@
+// MockHeosServer answers HEOS CLI commands like a HEOS device for the native tests.
+//
+// Usage:
+//   auto server = std::make_shared<MockHeosServer>();
+//   NativeNetwork::Listen(IPAddress(192,168,1,40), 1255, server);
+//   hc.Connect(IPAddress(192,168,1,40));
+//   hc.SetVolume(20);
+//   server->GetCount("player/set_volume");
+//
+// Note:
+// Each command gets a success response after the response delay. get_players returns
+// one player. Responses are delivered in order, so a delayed response also holds
+// back the ones after it, as on a TCP stream.
+// Every write of the client is captured with its virtual time.
+
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "NativeNetwork.h"
+
+class MockHeosServer : public NativeServer {
+public:
+  static const long PLAYER_ID = 1537612205; // pid of the first player
+
+  struct WRITE {
+    uint32_t time_ms;
+    std::string data;
+  };
+
+  //----- Settings -----//
+  void SetResponseDelay(uint32_t delay_ms){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_response_delay_ms = delay_ms;
+  }
+
+  /// SetCommandDelay delays responses to command. It overrides the response delay.
+  void SetCommandDelay(const std::string & command, uint32_t delay_ms){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_command_delay_ms[command] = delay_ms;
+  }
+
+  /// SetFailure makes command answer result=fail.
+  void SetFailure(const std::string & command, bool failure){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failure[command] = failure;
+  }
+
+  /// SetSilent stops answering without closing the connection, like a half-open socket.
+  void SetSilent(bool silent){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_silent = silent;
+  }
+
+  /// SetRefuse makes the server refuse new connections.
+  void SetRefuse(bool refuse){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_refuse = refuse;
+  }
+
+  //----- Actions -----//
+  /// SendLine sends a line on the current connection, e.g. an event.
+  void SendLine(const std::string & line, uint32_t delay_ms = 0){
+    std::shared_ptr<NativeConnection> connection = GetConnection();
+    if(connection){
+      connection->Send(line, delay_ms);
+    }
+  }
+
+  /// Close closes the current connection from the device side.
+  void Close(){
+    std::shared_ptr<NativeConnection> connection = GetConnection();
+    if(connection){
+      connection->Close();
+    }
+  }
+
+  //----- Results -----//
+  std::vector<WRITE> GetWrites(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writes;
+  }
+
+  /// @return number of times command was received. The command is without "heos://" and query.
+  int GetCount(const std::string & command){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counts.count(command) > 0 ? m_counts.at(command) : 0;
+  }
+
+  /// @return received command lines in order, with queries and without "\r\n".
+  std::vector<std::string> GetCommands(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_commands;
+  }
+
+  int GetConnectionCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_connection_count;
+  }
+
+  std::shared_ptr<NativeConnection> GetConnection(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_connection;
+  }
+
+  void ClearRecords(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writes.clear();
+    m_counts.clear();
+    m_commands.clear();
+  }
+
+  //----- NativeServer -----//
+  bool OnConnect(const std::shared_ptr<NativeConnection> & connection) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_refuse){
+      return false;
+    }
+    m_connection = connection;
+    m_connection_count++;
+    m_pending.clear();
+    return true;
+  }
+
+  void OnReceive(const std::shared_ptr<NativeConnection> & connection, const std::string & data) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writes.push_back(WRITE{ millis(), data });
+
+    m_pending += data;
+    size_t end;
+    while((end = m_pending.find("\r\n")) != std::string::npos){
+      const std::string line = m_pending.substr(0, end);
+      m_pending.erase(0, end + 2);
+      Answer(connection, line);
+    }
+  }
+
+private:
+  void Answer(const std::shared_ptr<NativeConnection> & connection, const std::string & line){
+    const std::string prefix = "heos://";
+    if(line.compare(0, prefix.size(), prefix) != 0){
+      return;
+    }
+    const size_t query_pos = line.find('?');
+    const std::string command = line.substr(prefix.size(), query_pos == std::string::npos ? std::string::npos : query_pos - prefix.size());
+    const std::string query = query_pos == std::string::npos ? std::string() : line.substr(query_pos + 1);
+    m_counts[command]++;
+    m_commands.push_back(line.substr(prefix.size()));
+
+    if(m_silent){
+      return;
+    }
+
+    const uint32_t delay_ms = m_command_delay_ms.count(command) > 0 ? m_command_delay_ms.at(command) : m_response_delay_ms;
+
+    const bool failure = m_failure.count(command) > 0 && m_failure.at(command);
+    const std::string result = failure ? "fail" : "success";
+    const std::string message = failure ? "eid=2&text=ID Not Valid&" + query : query;
+    const std::string payload = command == "player/get_players" && !failure ? MakePlayers() : std::string();
+    connection->Send(MakeLine(command, result, message, payload), delay_ms);
+  }
+
+  static std::string MakeLine(const std::string & command, const std::string & result, const std::string & message, const std::string & payload){
+    std::string line = "{\"heos\": {\"command\": \"" + command + "\", \"result\": \"" + result + "\", \"message\": \"" + message + "\"}";
+    if(!payload.empty()){
+      line += ", \"payload\": " + payload;
+    }
+    return line + "}\r\n";
+  }
+
+  static std::string MakePlayers(){
+    return "[{\"name\": \"Room 1\", \"pid\": " + std::to_string(PLAYER_ID) + ", \"model\": \"HEOS 1\", "
+           "\"version\": \"3.34.410\", \"ip\": \"192.168.1.50\", \"network\": \"wired\", "
+           "\"lineout\": 0, \"serial\": \"AMS28190412001\"}]";
+  }
+
+  std::mutex m_mutex;
+  std::shared_ptr<NativeConnection> m_connection;
+  std::string m_pending;
+  uint32_t m_response_delay_ms = 5;
+  std::map<std::string, uint32_t> m_command_delay_ms;
+  std::map<std::string, bool> m_failure;
+  bool m_silent = false;
+  bool m_refuse = false;
+  int m_connection_count = 0;
+
+  std::vector<WRITE> m_writes;
+  std::map<std::string, int> m_counts;
+  std::vector<std::string> m_commands;
+};
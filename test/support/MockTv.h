@@ -0,0 +1,301 @@
+// MockTv answers SSAP messages like an LG TV for the native tests.
+//
+// Usage:
+//   auto tv = std::make_shared<MockTv>();
+//   tv->SetInputs({ "HDMI_1", "HDMI_2" });
+//   NativeNetwork::Listen(IPAddress(192,168,1,41), 3000, tv);
+//   lc.Connect(IPAddress(192,168,1,41), MockTv::CLIENT_KEY);
+//   lc.SwitchInput(LgtvControl::InputId::HDMI2);
+//   tv->GetCount("ssap://tv/switchInput");
+//
+// Note:
+// Registration with CLIENT_KEY succeeds at once. Registration without a key answers the
+// pairing prompt first and registers after the pairing delay.
+// switchInput to an available input is answered with returnValue true, and then the new
+// foreground app is pushed to the app subscription after the switch delay.
+// PushApp() and PushAudio() push updates as the TV does when the remote control is used.
+// PushInputs() answers the last getExternalInputList request again with the current inputs.
+
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "NativeNetwork.h"
+
+class MockTv : public NativeServer {
+public:
+  static constexpr const char * CLIENT_KEY = "5f1a3c7e9b2d4f6a8c0e1b3d5f7a9c2e";
+
+  //----- Settings -----//
+  /// SetInputs sets the ids of the external inputs, e.g. "HDMI_1".
+  void SetInputs(const std::vector<std::string> & inputs){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inputs = inputs;
+  }
+
+  void SetApp(const std::string & app_id){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_app_id = app_id;
+  }
+
+  void SetResponseDelay(uint32_t delay_ms){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_response_delay_ms = delay_ms;
+  }
+
+  void SetSwitchDelay(uint32_t delay_ms){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_switch_delay_ms = delay_ms;
+  }
+
+  void SetPairingDelay(uint32_t delay_ms){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pairing_delay_ms = delay_ms;
+  }
+
+  /// SetAnswersPing(false) makes the connection half-open. The client drops it after its pong timeout.
+  void SetAnswersPing(bool answers){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_answers_ping = answers;
+  }
+
+  /// SetSilent stops answering messages while keeping the connection.
+  void SetSilent(bool silent){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_silent = silent;
+  }
+
+  void SetRefuse(bool refuse){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_refuse = refuse;
+  }
+
+  //----- Actions -----//
+  /// PushApp changes the foreground app and notifies the subscriber.
+  void PushApp(const std::string & app_id, uint32_t delay_ms = 0){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_app_id = app_id;
+    if(m_connection && !m_app_sub_id.empty()){
+      m_connection->Send(MakeApp(m_app_sub_id), delay_ms);
+    }
+  }
+
+  /// PushAudio changes the volume and mute state and notifies the subscriber.
+  void PushAudio(int volume, bool mute, uint32_t delay_ms = 0){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_volume = volume;
+    m_mute = mute;
+    if(m_connection && !m_audio_sub_id.empty()){
+      m_connection->Send(MakeAudio(m_audio_sub_id), delay_ms);
+    }
+  }
+
+  /// PushInputs sends the current inputs as a response to the last getExternalInputList request.
+  void PushInputs(uint32_t delay_ms = 0){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_connection && !m_inputs_req_id.empty()){
+      m_connection->Send(MakeInputs(m_inputs_req_id), delay_ms);
+    }
+  }
+
+  /// SendFrame sends a raw frame on the current connection.
+  void SendFrame(const std::string & frame, uint32_t delay_ms = 0){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_connection){
+      m_connection->Send(frame, delay_ms);
+    }
+  }
+
+  /// Close closes the current connection from the TV side.
+  void Close(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_connection){
+      m_connection->Close();
+    }
+  }
+
+  //----- Results -----//
+  /// @return number of messages received for uri. "register" counts registrations.
+  int GetCount(const std::string & uri){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counts.count(uri) > 0 ? m_counts.at(uri) : 0;
+  }
+
+  /// @return inputIds of switchInput requests in order.
+  std::vector<std::string> GetSwitchRequests(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_switch_requests;
+  }
+
+  int GetConnectionCount(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_connection_count;
+  }
+
+  std::string GetApp(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_app_id;
+  }
+
+  void ClearRecords(){
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts.clear();
+    m_switch_requests.clear();
+  }
+
+  //----- NativeServer -----//
+  bool OnConnect(const std::shared_ptr<NativeConnection> & connection) override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_refuse){
+      return false;
+    }
+    m_connection = connection;
+    m_connection_count++;
+    m_app_sub_id.clear();
+    m_audio_sub_id.clear();
+    m_inputs_req_id.clear();
+    return true;
+  }
+
+  void OnReceive(const std::shared_ptr<NativeConnection> & connection, const std::string & data) override {
+    StaticJsonDocument<256> filter;
+    filter["id"] = true;
+    filter["type"] = true;
+    filter["uri"] = true;
+    filter["payload"]["client-key"] = true;
+    filter["payload"]["inputId"] = true;
+
+    DynamicJsonDocument doc(1024);
+    if(deserializeJson(doc, data.c_str(), data.size(), DeserializationOption::Filter(filter))){
+      return;
+    }
+    const std::string id = doc["id"] | "";
+    const std::string type = doc["type"] | "";
+    const std::string uri = doc["uri"] | "";
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts[type == "register" ? type : uri]++;
+    if(m_silent){
+      return;
+    }
+
+    if(type == "register"){
+      const std::string key = doc["payload"]["client-key"] | "";
+      if(key == CLIENT_KEY){
+        connection->Send(MakeRegistered(id), m_response_delay_ms);
+        return;
+      }
+      connection->Send("{\"type\":\"response\",\"id\":\"" + id + "\",\"payload\":{\"pairingType\":\"PROMPT\",\"returnValue\":true}}", m_response_delay_ms);
+      connection->Send(MakeRegistered(id), m_pairing_delay_ms);
+      return;
+    }
+
+    if(type == "subscribe" && uri == "ssap://com.webos.applicationManager/getForegroundAppInfo"){
+      m_app_sub_id = id;
+      connection->Send(MakeApp(id), m_response_delay_ms);
+    }else if(type == "subscribe" && uri == "ssap://audio/getStatus"){
+      m_audio_sub_id = id;
+      connection->Send(MakeAudio(id), m_response_delay_ms);
+    }else if(type == "request" && uri == "ssap://tv/getExternalInputList"){
+      m_inputs_req_id = id;
+      connection->Send(MakeInputs(id), m_response_delay_ms);
+    }else if(type == "request" && uri == "ssap://tv/switchInput"){
+      const std::string input = doc["payload"]["inputId"] | "";
+      m_switch_requests.push_back(input);
+      if(!HasInput(input)){
+        connection->Send("{\"type\":\"response\",\"id\":\"" + id + "\",\"payload\":{\"returnValue\":false,\"errorCode\":\"-1000\",\"errorText\":\"Input " + input + " is not available\"}}", m_response_delay_ms);
+        return;
+      }
+      connection->Send("{\"type\":\"response\",\"id\":\"" + id + "\",\"payload\":{\"returnValue\":true}}", m_response_delay_ms);
+      m_app_id = GetAppId(input);
+      if(!m_app_sub_id.empty()){
+        connection->Send(MakeApp(m_app_sub_id), m_switch_delay_ms);
+      }
+    }else{
+      connection->Send("{\"type\":\"error\",\"id\":\"" + id + "\",\"error\":\"404 no such service or method\",\"payload\":{}}", m_response_delay_ms);
+    }
+  }
+
+  bool AnswersPing() override {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_answers_ping;
+  }
+
+private:
+  bool HasInput(const std::string & input) const {
+    for(const std::string & item : m_inputs){
+      if(item == input){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // "HDMI_2" is shown by "com.webos.app.hdmi2".
+  static std::string GetAppId(const std::string & input){
+    std::string app_id = "com.webos.app.";
+    for(char c : input){
+      if(c != '_'){
+        app_id += (char)tolower((unsigned char)c);
+      }
+    }
+    return app_id;
+  }
+
+  static std::string MakeRegistered(const std::string & id){
+    return "{\"type\":\"registered\",\"id\":\"" + id + "\",\"payload\":{\"client-key\":\"" + CLIENT_KEY + "\"}}";
+  }
+
+  std::string MakeApp(const std::string & id) const {
+    return "{\"type\":\"response\",\"id\":\"" + id + "\",\"payload\":{\"subscribed\":true,\"appId\":\"" + m_app_id +
+           "\",\"returnValue\":true,\"windowId\":\"\",\"processId\":\"\"}}";
+  }
+
+  std::string MakeAudio(const std::string & id) const {
+    const std::string volume = std::to_string(m_volume);
+    const std::string mute = m_mute ? "true" : "false";
+    return "{\"type\":\"response\",\"id\":\"" + id + "\",\"payload\":{\"subscribed\":true,\"volumeStatus\":{\"activeStatus\":true,"
+           "\"adjustVolume\":true,\"maxVolume\":100,\"muteCompatible\":true,\"muteStatus\":" + mute + ",\"soundOutput\":\"tv_speaker\","
+           "\"volume\":" + volume + ",\"mode\":\"normal\"},\"callerId\":\"com.webos.service.apiadapter\",\"mute\":" + mute +
+           ",\"volume\":" + volume + ",\"returnValue\":true}}";
+  }
+
+  std::string MakeInputs(const std::string & id) const {
+    std::string devices;
+    for(size_t i = 0; i < m_inputs.size(); i++){
+      const std::string & input = m_inputs[i];
+      if(i > 0){
+        devices += ",";
+      }
+      devices += "{\"id\":\"" + input + "\",\"label\":\"" + input + "\",\"port\":" + std::to_string(i + 1) +
+                 ",\"connected\":true,\"appId\":\"" + GetAppId(input) + "\",\"icon\":\"http://192.168.1.41:3000/resources/" +
+                 "f8f7b4b8b27e8a1f5b2e3a8c6e0d0a4d7b1c9e2a/aGRtaTEucG5n\",\"modified\":false,\"lastUniqueId\":" +
+                 std::to_string(i + 1) + ",\"subList\":[],\"subCount\":0,\"favorite\":false}";
+    }
+    return "{\"type\":\"response\",\"id\":\"" + id + "\",\"payload\":{\"devices\":[" + devices + "],\"returnValue\":true}}";
+  }
+
+  std::mutex m_mutex;
+  std::shared_ptr<NativeConnection> m_connection;
+  std::vector<std::string> m_inputs = { "HDMI_1", "HDMI_2", "HDMI_3", "HDMI_4" };
+  std::string m_app_id = "com.webos.app.hdmi1";
+  int m_volume = 12;
+  bool m_mute = false;
+  uint32_t m_response_delay_ms = 10;
+  uint32_t m_switch_delay_ms = 300;
+  uint32_t m_pairing_delay_ms = 2000;
+  bool m_answers_ping = true;
+  bool m_silent = false;
+  bool m_refuse = false;
+  int m_connection_count = 0;
+  std::string m_app_sub_id;
+  std::string m_audio_sub_id;
+  std::string m_inputs_req_id;
+
+  std::map<std::string, int> m_counts;
+  std::vector<std::string> m_switch_requests;
+};
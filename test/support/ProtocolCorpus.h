@@ -0,0 +1,184 @@
+// Corpus of HEOS CLI lines and SSAP frames replayed by the benchmark and the fuzz target.
+//
+// Messages follow the HEOS CLI Protocol Specification v1.17 and the SSAP messages handled by
+// hobbyquaker/lgtv2. Player IDs, serial numbers and client keys are made up.
+//
+// Usage:
+//   for(const CORPUS_ENTRY & entry : HEOS_CORPUS){
+//     replay(entry.data, strlen(entry.data));
+//   }
+//
+// Note:
+// valid is true for well-formed JSON. Such entries must parse without NoMemory.
+// HEOS lines end with "\r\n" as on the wire, except truncated ones.
+// Message IDs of the SSAP frames match CORPUS_APP_SUB_ID, CORPUS_AUDIO_SUB_ID and
+// CORPUS_INPUTS_REQ_ID so that they reach LgtvControl::UpdateState.
+
+#pragma once
+
+#include <cstddef>
+
+struct CORPUS_ENTRY {
+  const char * name;
+  const char * data;
+  bool valid;
+};
+
+static const char * const CORPUS_APP_SUB_ID    = "abcdef100002";
+static const char * const CORPUS_AUDIO_SUB_ID  = "abcdef100003";
+static const char * const CORPUS_INPUTS_REQ_ID = "abcdef100004";
+
+#define CORPUS_PLAYER(name, pid, model, ip, serial) \
+  "{\"name\": \"" name "\", \"pid\": " pid ", \"gid\": " pid ", \"model\": \"" model "\", " \
+  "\"version\": \"3.34.410\", \"ip\": \"" ip "\", \"network\": \"wired\", \"lineout\": 0, " \
+  "\"serial\": \"" serial "\"}"
+
+static const CORPUS_ENTRY HEOS_CORPUS[] = {
+  // small acks
+  { "set_volume",
+    "{\"heos\": {\"command\": \"player/set_volume\", \"result\": \"success\", \"message\": \"pid=-1265379422&level=20\"}}\r\n", true },
+  { "volume_up",
+    "{\"heos\": {\"command\": \"player/volume_up\", \"result\": \"success\", \"message\": \"pid=-1265379422&step=5\"}}\r\n", true },
+  { "set_mute",
+    "{\"heos\": {\"command\": \"player/set_mute\", \"result\": \"success\", \"message\": \"pid=-1265379422&state=on\"}}\r\n", true },
+  { "toggle_mute",
+    "{\"heos\": {\"command\": \"player/toggle_mute\", \"result\": \"success\", \"message\": \"pid=-1265379422\"}}\r\n", true },
+  { "play_input",
+    "{\"heos\": {\"command\": \"player/play_input\", \"result\": \"success\", \"message\": \"pid=-1265379422&input=inputs/usbdac\"}}\r\n", true },
+  { "heart_beat",
+    "{\"heos\": {\"command\": \"system/heart_beat\", \"result\": \"success\", \"message\": \"\"}}\r\n", true },
+  { "set_volume_fail",
+    "{\"heos\": {\"command\": \"player/set_volume\", \"result\": \"fail\", \"message\": \"eid=2&text=ID Not Valid&pid=1\"}}\r\n", true },
+  { "play_input_interim",
+    "{\"heos\": {\"command\": \"player/play_input\", \"result\": \"success\", \"message\": \"command under process&pid=-1265379422&input=inputs/optical_in_1\"}}\r\n", true },
+
+  // get_players
+  { "get_players_1",
+    "{\"heos\": {\"command\": \"player/get_players\", \"result\": \"success\", \"message\": \"\"}, \"payload\": ["
+    CORPUS_PLAYER("Living Room", "-1265379422", "Denon AVR-X1700H", "192.168.1.40", "BBW17190815234")
+    "]}\r\n", true },
+  { "get_players_8",
+    "{\"heos\": {\"command\": \"player/get_players\", \"result\": \"success\", \"message\": \"\"}, \"payload\": ["
+    CORPUS_PLAYER("Living Room", "-1265379422", "Denon AVR-X1700H", "192.168.1.40", "BBW17190815234") ", "
+    CORPUS_PLAYER("Kitchen", "1537612205", "HEOS 1", "192.168.1.51", "AMS28190412001") ", "
+    CORPUS_PLAYER("Bedroom", "-80522311", "HEOS 3", "192.168.1.52", "AMS28190412002") ", "
+    CORPUS_PLAYER("Bathroom", "811023577", "HEOS 1", "192.168.1.53", "AMS28190412003") ", "
+    CORPUS_PLAYER("Office", "-1920344781", "Denon Home 150", "192.168.1.54", "AMS28190412004") ", "
+    CORPUS_PLAYER("Dining Room", "2003491876", "Denon Home 250", "192.168.1.55", "AMS28190412005") ", "
+    CORPUS_PLAYER("Garage", "-431977210", "HEOS Drive", "192.168.1.56", "AMS28190412006") ", "
+    CORPUS_PLAYER("Patio", "119348720", "HEOS Amp", "192.168.1.57", "AMS28190412007")
+    "]}\r\n", true },
+
+  // events
+  { "event_volume_changed",
+    "{\"heos\": {\"command\": \"event/player_volume_changed\", \"message\": \"pid=-1265379422&level=25&mute=off\"}}\r\n", true },
+  { "event_state_changed",
+    "{\"heos\": {\"command\": \"event/player_state_changed\", \"message\": \"pid=-1265379422&state=play\"}}\r\n", true },
+  { "event_players_changed",
+    "{\"heos\": {\"command\": \"event/players_changed\", \"message\": \"\"}}\r\n", true },
+  { "event_now_playing_changed",
+    "{\"heos\": {\"command\": \"event/player_now_playing_changed\", \"message\": \"pid=-1265379422\"}}\r\n", true },
+
+  // structures that need many slots for their length
+  { "wide_payload",
+    "{\"heos\": {\"command\": \"player/get_players\", \"result\": \"success\", \"message\": \"\"}, \"payload\": ["
+    "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+    "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+    "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+    "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,"
+    "0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]}\r\n", true },
+  { "empty_objects",
+    "{\"heos\": {\"command\": \"event/sources_changed\", \"message\": \"\"}, \"payload\": [{},{},{},{},{},{},{},{},{},{},"
+    "{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{}]}\r\n", true },
+
+  // malformed
+  { "empty", "\r\n", false },
+  { "not_json", "HTTP/1.1 400 Bad Request\r\n", false },
+  { "empty_object", "{}\r\n", true },
+  { "heos_not_object", "{\"heos\": 5}\r\n", true },
+  { "command_not_string", "{\"heos\": {\"command\": 7, \"result\": \"success\"}}\r\n", true },
+  { "no_result", "{\"heos\": {\"command\": \"player/set_volume\", \"message\": \"pid=1\"}}\r\n", true },
+  { "deep_nesting", "{\"heos\": [[[[[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]]]]}\r\n", false },
+  { "bad_escape", "{\"heos\": {\"command\": \"player/set\\qvolume\", \"result\": \"success\"}}\r\n", false },
+  { "control_characters", "{\"heos\": {\"command\": \"player/\x01\x02\x7f\", \"result\": \"success\"}}\r\n", false },
+
+  // truncated
+  { "truncated_ack", "{\"heos\": {\"command\": \"player/set_volume\", \"result\": \"succ", false },
+  { "truncated_players",
+    "{\"heos\": {\"command\": \"player/get_players\", \"result\": \"success\", \"message\": \"\"}, \"payload\": ["
+    "{\"name\": \"Living Room\", \"pid\": -12653", false },
+  { "truncated_event", "{\"heos\": {\"command\": \"event/player_volume_changed\", \"message\": \"pid=-1265379422&lev\r\n", false }
+};
+
+#define CORPUS_DEVICE(n, label, connected) \
+  "{\"id\":\"HDMI_" #n "\",\"label\":\"" label "\",\"port\":" #n ",\"connected\":" connected "," \
+  "\"appId\":\"com.webos.app.hdmi" #n "\",\"icon\":\"http://192.168.1.41:3000/resources/f8f7b4b8b27e8a1f5b2e3a8c6e0d0a4d7b1c9e2a/" \
+  "aGRtaTEucG5n\",\"modified\":false,\"spdProductDescription\":\"\",\"spdVendorName\":\"\",\"spdSourceDeviceInfo\":\"\"," \
+  "\"lastUniqueId\":" #n ",\"subList\":[],\"subCount\":0,\"favorite\":false}"
+
+static const CORPUS_ENTRY SSAP_CORPUS[] = {
+  // registration
+  { "register_prompt",
+    "{\"type\":\"response\",\"id\":\"abcdef100001\",\"payload\":{\"pairingType\":\"PROMPT\",\"returnValue\":true}}", true },
+  { "registered",
+    "{\"type\":\"registered\",\"id\":\"abcdef100001\",\"payload\":{\"client-key\":\"5f1a3c7e9b2d4f6a8c0e1b3d5f7a9c2e\"}}", true },
+
+  // subscriptions
+  { "foreground_app_hdmi1",
+    "{\"type\":\"response\",\"id\":\"abcdef100002\",\"payload\":{\"subscribed\":true,\"appId\":\"com.webos.app.hdmi1\","
+    "\"returnValue\":true,\"windowId\":\"\",\"processId\":\"\"}}", true },
+  { "foreground_app_netflix",
+    "{\"type\":\"response\",\"id\":\"abcdef100002\",\"payload\":{\"subscribed\":true,\"appId\":\"netflix\","
+    "\"returnValue\":true,\"windowId\":\"\",\"processId\":\"\"}}", true },
+  { "audio_status_legacy",
+    "{\"type\":\"response\",\"id\":\"abcdef100003\",\"payload\":{\"returnValue\":true,\"callerId\":\"secondscreen.client\","
+    "\"mute\":false,\"volume\":12,\"scenario\":\"mastervolume_tv_speaker\",\"action\":\"requested\",\"volumeMax\":100,"
+    "\"subscribed\":true}}", true },
+  { "audio_status_webos6",
+    "{\"type\":\"response\",\"id\":\"abcdef100003\",\"payload\":{\"subscribed\":true,\"volumeStatus\":{\"activeStatus\":true,"
+    "\"adjustVolume\":true,\"maxVolume\":100,\"muteCompatible\":true,\"muteStatus\":true,\"soundOutput\":\"tv_speaker\","
+    "\"volume\":15,\"mode\":\"normal\",\"externalDeviceControl\":false,\"volumeSyncable\":true},"
+    "\"callerId\":\"com.webos.service.apiadapter\",\"mute\":true,\"volume\":15,\"returnValue\":true}}", true },
+
+  // requests
+  { "external_input_list",
+    "{\"type\":\"response\",\"id\":\"abcdef100004\",\"payload\":{\"devices\":["
+    CORPUS_DEVICE(1, "Apple TV", "true") ","
+    CORPUS_DEVICE(2, "PlayStation 5", "true") ","
+    CORPUS_DEVICE(3, "HDMI 3", "false") ","
+    CORPUS_DEVICE(4, "Soundbar", "true")
+    "],\"returnValue\":true}}", true },
+  { "switch_input_ok",
+    "{\"type\":\"response\",\"id\":\"abcdef100005\",\"payload\":{\"returnValue\":true}}", true },
+  { "switch_input_fail",
+    "{\"type\":\"response\",\"id\":\"abcdef100006\",\"payload\":{\"returnValue\":false,\"errorCode\":\"-1000\","
+    "\"errorText\":\"Input HDMI_9 is not available\"}}", true },
+  { "error_no_service",
+    "{\"type\":\"error\",\"id\":\"abcdef100007\",\"error\":\"404 no such service or method\",\"payload\":{}}", true },
+
+  // malformed
+  { "empty", "", false },
+  { "not_json", "pong", false },
+  { "array_root", "[1,2,3]", true },
+  { "wrong_types", "{\"type\":5,\"id\":null,\"payload\":[]}", true },
+  { "payload_string", "{\"type\":\"response\",\"id\":\"abcdef100002\",\"payload\":\"com.webos.app.hdmi2\"}", true },
+  { "devices_not_array",
+    "{\"type\":\"response\",\"id\":\"abcdef100004\",\"payload\":{\"devices\":{\"id\":\"HDMI_1\"},\"returnValue\":true}}", true },
+  { "device_id_number",
+    "{\"type\":\"response\",\"id\":\"abcdef100004\",\"payload\":{\"devices\":[{\"id\":1},{\"id\":null}],\"returnValue\":true}}", true },
+  { "deep_nesting", "{\"payload\":[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]}", false },
+
+  // truncated
+  { "truncated_app",
+    "{\"type\":\"response\",\"id\":\"abcdef100002\",\"payload\":{\"subscribed\":true,\"appId\":\"com.webos.app.hd", false },
+  { "truncated_inputs",
+    "{\"type\":\"response\",\"id\":\"abcdef100004\",\"payload\":{\"devices\":["
+    CORPUS_DEVICE(1, "Apple TV", "true") ",{\"id\":\"HDMI_2\",\"lab", false },
+  { "truncated_escape", "{\"type\":\"response\",\"id\":\"abcdef100002\\", false }
+};
+
+#undef CORPUS_PLAYER
+#undef CORPUS_DEVICE
+
+static const size_t HEOS_CORPUS_SIZE = sizeof(HEOS_CORPUS) / sizeof(HEOS_CORPUS[0]);
+static const size_t SSAP_CORPUS_SIZE = sizeof(SSAP_CORPUS) / sizeof(SSAP_CORPUS[0]);
@@ -0,0 +1,212 @@
+// Tests of DeviceDiscovery and of the controllers finding a device again after its address changed.
+//
+// SSDP responders answer M-SEARCH on the loopback of NativeNetwork like the devices on a LAN.
+// The move tests print the time from an address change to the first command reaching the device.
+// Disconnect() comes before the assertions so that a failed test does not leave a handler
+// running on a destroyed controller.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "NativeNetwork.h"
+#include "Preferences.h"
+#include "DeviceDiscovery.h"
+#include "HeosControl.h"
+#include "LgtvControl.h"
+#include "MockHeosServer.h"
+#include "MockTv.h"
+
+namespace {
+  const char * const HEOS_ST = "urn:schemas-denon-com:device:ACT-Denon:1";
+  const char * const LGTV_ST = "urn:lge-com:service:webos-second-screen:1";
+  const IPAddress OLD_ADDRESS(192,168,1,40);
+  const IPAddress NEW_ADDRESS(192,168,1,60);
+
+  // SSDP_DEVICE is a device on the LAN as seen by SSDP. The test may change it at any time.
+  struct SSDP_DEVICE {
+    std::string st;
+    std::string uuid;
+    IPAddress address;
+    uint32_t delay_ms = 50;
+    bool answers = true;
+    int searches = 0;
+  };
+
+  // AddSsdpResponder answers M-SEARCH for the search target of device like the device does.
+  std::shared_ptr<SSDP_DEVICE> AddSsdpResponder(const char * st, const char * uuid, IPAddress address, uint32_t delay_ms = 50){
+    auto device = std::make_shared<SSDP_DEVICE>();
+    device->st = st;
+    device->uuid = uuid;
+    device->address = address;
+    device->delay_ms = delay_ms;
+    NativeNetwork::AddUdpResponder([device](IPAddress to, uint16_t port, const std::string & request, std::vector<NativeNetwork::UDP_REPLY> & replies){
+      if(port != 1900 || request.find("ST: " + device->st) == std::string::npos || !device->answers){
+        return;
+      }
+      device->searches++;
+      const std::string reply = "HTTP/1.1 200 OK\r\nCACHE-CONTROL: max-age=1800\r\nEXT:\r\n"
+                                "LOCATION: http://" + std::string(device->address.toString().c_str()) + ":60006/upnp/desc.xml\r\n"
+                                "ST: " + device->st + "\r\nUSN: uuid:" + device->uuid + "::" + device->st + "\r\n\r\n";
+      replies.push_back(NativeNetwork::UDP_REPLY{ device->address, 1900, reply, device->delay_ms });
+    });
+    return device;
+  }
+
+  // WaitFor polls condition every 10 ms.
+  // @return elapsed ms until condition became true, or timeout_ms if it did not.
+  template <typename F>
+  uint32_t WaitFor(F condition, uint32_t timeout_ms){
+    const uint32_t start_ms = millis();
+    while(!condition() && millis() - start_ms < timeout_ms){
+      delay(10);
+    }
+    return millis() - start_ms;
+  }
+}
+
+void setUp(void){
+  NativeNetwork::Reset();
+  NativePreferences::Clear();
+}
+
+void tearDown(void){
+}
+
+void test_discover_async_reports_address(void){
+  AddSsdpResponder(HEOS_ST, "5f9ec1b3-ed59-1900-4530-00a0dea7c5b1", NEW_ADDRESS, 300);
+  DeviceDiscovery dd;
+  dd.Begin();
+
+  volatile uint32_t found = 1;
+  TEST_ASSERT_TRUE(dd.DiscoverAsync(DeviceDiscovery::DEVICE::Heos, [&found](IPAddress address){ found = (uint32_t)address; }));
+  // A second request while the first one runs is ignored.
+  TEST_ASSERT_FALSE(dd.DiscoverAsync(DeviceDiscovery::DEVICE::Heos, [](IPAddress address){}));
+  delay(1000);
+
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)NEW_ADDRESS, found);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)NEW_ADDRESS, (uint32_t)dd.GetAddress(DeviceDiscovery::DEVICE::Heos));
+
+  // Nothing answers for the TV.
+  found = 1;
+  TEST_ASSERT_TRUE(dd.DiscoverAsync(DeviceDiscovery::DEVICE::Lgtv, [&found](IPAddress address){ found = (uint32_t)address; }, 500));
+  delay(1000);
+  TEST_ASSERT_EQUAL_UINT32(0, found);
+}
+
+void test_heos_moves_once_per_outage(void){
+  auto old_server = std::make_shared<MockHeosServer>();
+  auto new_server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(OLD_ADDRESS, 1255, old_server);
+  NativeNetwork::Listen(NEW_ADDRESS, 1255, new_server);
+  AddSsdpResponder(HEOS_ST, "5f9ec1b3-ed59-1900-4530-00a0dea7c5b1", NEW_ADDRESS, 1500);
+
+  DeviceDiscovery dd;
+  dd.Begin();
+  HeosControl hc;
+  int requests = 0;
+  hc.SetRediscoverCallback([&](){
+    requests++;
+    dd.DiscoverAsync(DeviceDiscovery::DEVICE::Heos, [&hc](IPAddress address){ hc.UpdateAddress(address); });
+  });
+  TEST_ASSERT_TRUE(hc.Connect(OLD_ADDRESS));
+
+  // DHCP gave the device a new address. Reconnects to the old one keep failing meanwhile.
+  // Time to first command is taken from the move to the command reaching the device.
+  old_server->SetRefuse(true);
+  old_server->Close();
+  hc.SetVolume(20);
+  const uint32_t elapsed_ms = WaitFor([&](){ return new_server->GetCount("player/set_volume") > 0; }, 10000);
+  printf("  HEOS time to first command after IP change: %u ms\n", (unsigned)elapsed_ms);
+  delay(3000);
+  const int requests_first = requests;
+  const int set_volume_first = new_server->GetCount("player/set_volume");
+
+  // A new outage asks for discovery again.
+  new_server->SetRefuse(true);
+  new_server->Close();
+  delay(8000);
+  hc.Disconnect();
+
+  // Backoff 250 ms, a failed connect of 100 ms and the scan of 1500 ms.
+  TEST_ASSERT_LESS_THAN(2500, elapsed_ms);
+  TEST_ASSERT_EQUAL(1, requests_first);
+  TEST_ASSERT_EQUAL(1, set_volume_first);
+  TEST_ASSERT_EQUAL(2, requests);
+}
+
+void test_lgtv_moves_once_per_outage(void){
+  auto old_tv = std::make_shared<MockTv>();
+  auto new_tv = std::make_shared<MockTv>();
+  NativeNetwork::Listen(OLD_ADDRESS, 3000, old_tv);
+  NativeNetwork::Listen(NEW_ADDRESS, 3000, new_tv);
+  AddSsdpResponder(LGTV_ST, "c7b6a3f0-1f4e-4b1a-9d2c-38e2d7a9b0c4", NEW_ADDRESS, 1500);
+
+  DeviceDiscovery dd;
+  dd.Begin();
+  LgtvControl lc;
+  int requests = 0;
+  lc.SetRediscoverCallback([&](){
+    requests++;
+    dd.DiscoverAsync(DeviceDiscovery::DEVICE::Lgtv, [&lc](IPAddress address){ lc.UpdateAddress(address); });
+  });
+  TEST_ASSERT_TRUE(lc.Connect(OLD_ADDRESS, MockTv::CLIENT_KEY));
+
+  old_tv->SetRefuse(true);
+  old_tv->Close();
+  lc.SwitchInput(LgtvControl::InputId::HDMI2);
+  const uint32_t elapsed_ms = WaitFor([&](){ return !new_tv->GetSwitchRequests().empty(); }, 10000);
+  printf("  LGTV time to first command after IP change: %u ms\n", (unsigned)elapsed_ms);
+  delay(3000);
+  const int requests_first = requests;
+  const bool registered_first = lc.IsRegistered();
+  const std::vector<std::string> switches = new_tv->GetSwitchRequests();
+
+  new_tv->SetRefuse(true);
+  new_tv->Close();
+  delay(8000);
+  lc.Disconnect();
+
+  // Two failed attempts with backoff before the scan of 1500 ms, then registration.
+  TEST_ASSERT_LESS_THAN(3500, elapsed_ms);
+  TEST_ASSERT_EQUAL(1, requests_first);
+  TEST_ASSERT_TRUE(registered_first);
+  TEST_ASSERT_EQUAL(1, switches.size());
+  TEST_ASSERT_EQUAL_STRING("HDMI_2", switches[0].c_str());
+  TEST_ASSERT_EQUAL(2, requests);
+}
+
+void test_known_device_is_preferred(void){
+  auto kitchen = AddSsdpResponder(HEOS_ST, "5f9ec1b3-ed59-1900-4530-00a0dea7c5b1", OLD_ADDRESS, 50);
+  DeviceDiscovery dd;
+  dd.Begin();
+  TEST_ASSERT_TRUE(dd.Discover(DeviceDiscovery::DEVICE::Heos));
+  TEST_ASSERT_EQUAL_STRING("5f9ec1b3-ed59-1900-4530-00a0dea7c5b1", dd.GetUuid(DeviceDiscovery::DEVICE::Heos).c_str());
+
+  // Another HEOS device answers first, but the known one is taken at its new address.
+  auto bedroom = AddSsdpResponder(HEOS_ST, "0b4c2e6a-8d1f-4e3b-a5c7-19f0d2b8e6a4", IPAddress(192,168,1,70), 20);
+  kitchen->address = NEW_ADDRESS;
+  kitchen->delay_ms = 800;
+  TEST_ASSERT_TRUE(dd.Discover(DeviceDiscovery::DEVICE::Heos));
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)NEW_ADDRESS, (uint32_t)dd.GetAddress(DeviceDiscovery::DEVICE::Heos));
+
+  // The UUID survives a reboot.
+  DeviceDiscovery rebooted;
+  rebooted.Begin();
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)NEW_ADDRESS, (uint32_t)rebooted.GetAddress(DeviceDiscovery::DEVICE::Heos));
+  TEST_ASSERT_EQUAL_STRING("5f9ec1b3-ed59-1900-4530-00a0dea7c5b1", rebooted.GetUuid(DeviceDiscovery::DEVICE::Heos).c_str());
+
+  // If the known device is gone, the other one is taken.
+  kitchen->answers = false;
+  TEST_ASSERT_TRUE(dd.Discover(DeviceDiscovery::DEVICE::Heos, 1000));
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)IPAddress(192,168,1,70), (uint32_t)dd.GetAddress(DeviceDiscovery::DEVICE::Heos));
+  TEST_ASSERT_EQUAL_STRING("0b4c2e6a-8d1f-4e3b-a5c7-19f0d2b8e6a4", dd.GetUuid(DeviceDiscovery::DEVICE::Heos).c_str());
+  TEST_ASSERT_GREATER_THAN(0, bedroom->searches);
+}
+
+int main(int argc, char ** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_discover_async_reports_address);
+  RUN_TEST(test_known_device_is_preferred);
+  RUN_TEST(test_heos_moves_once_per_outage);
+  RUN_TEST(test_lgtv_moves_once_per_outage);
+  return UNITY_END();
+}
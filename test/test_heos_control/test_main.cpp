@@ -0,0 +1,278 @@
+// Tests of HeosControl against MockHeosServer.
+//
+// CommandHandler runs as a task on virtual time, so the delays below cost no host time.
+// Disconnect() comes before the assertions so that a failed test does not leave the handler
+// running on a destroyed HeosControl.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "NativeNetwork.h"
+#include "HeosControlProbe.h"
+#include "MockHeosServer.h"
+
+namespace {
+  struct RESULT {
+    HeosControl::COMMAND cmd;
+    bool success;
+    uint32_t time_ms;
+  };
+
+  const IPAddress HEOS_ADDRESS(192,168,1,40);
+  const std::string VOLUME_EVENT = "{\"heos\": {\"command\": \"event/player_volume_changed\", \"message\": \"pid=1537612205&level=25&mute=off\"}}\r\n";
+}
+
+void setUp(void){
+  NativeNetwork::Reset();
+}
+
+void tearDown(void){
+}
+
+void test_line_continues_after_timeout(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  HeosControlProbe probe(hc);
+  TEST_ASSERT_TRUE(probe.Attach(HEOS_ADDRESS));
+
+  const size_t half = VOLUME_EVENT.size() / 2;
+  server->SendLine(VOLUME_EVENT.substr(0, half));
+  TEST_ASSERT_TRUE(probe.WaitJsonResponse(100).isEmpty());
+  server->SendLine(VOLUME_EVENT.substr(half));
+  const String line = probe.WaitJsonResponse(100);
+  TEST_ASSERT_EQUAL_STRING(VOLUME_EVENT.c_str(), line.c_str());
+  probe.Detach();
+}
+
+void test_event_split_while_idle(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  std::vector<String> events;
+  hc.AddEventCallback([&events](DynamicJsonDocument doc){ events.push_back(doc["heos"]["message"].as<String>()); });
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+
+  // The idle read gives up after 100 ms. The second half arrives later than that.
+  const size_t half = VOLUME_EVENT.size() / 2;
+  server->SendLine(VOLUME_EVENT.substr(0, half));
+  server->SendLine(VOLUME_EVENT.substr(half), 300);
+  delay(1000);
+  hc.Disconnect();
+
+  TEST_ASSERT_EQUAL(1, events.size());
+  TEST_ASSERT_EQUAL_STRING("pid=1537612205&level=25&mute=off", events[0].c_str());
+}
+
+void test_late_response_during_heartbeat(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+
+  // The response misses the 500 ms deadline, so a heartbeat is sent. The response arrives
+  // before the heartbeat answer and completes the task.
+  server->SetCommandDelay("player/get_players", 700);
+  int responses = 0;
+  hc.GetPlayers([&responses](DynamicJsonDocument doc){ responses++; });
+  delay(3000);
+  hc.Disconnect();
+
+  TEST_ASSERT_EQUAL(1, responses);
+  TEST_ASSERT_EQUAL(2, server->GetCount("player/get_players"));
+  TEST_ASSERT_EQUAL(1, server->GetCount("system/heart_beat"));
+  TEST_ASSERT_EQUAL(1, server->GetConnectionCount());
+}
+
+void test_scene_is_one_write(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+  delay(100);
+  server->ClearRecords();
+
+  hc.BeginBatch();
+  hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
+  hc.SetVolume(25);
+  TEST_ASSERT_TRUE(hc.Commit());
+  delay(500);
+
+  hc.Disconnect();
+  const std::vector<MockHeosServer::WRITE> writes = server->GetWrites();
+  const std::vector<std::string> commands = server->GetCommands();
+  TEST_ASSERT_EQUAL(1, writes.size());
+  TEST_ASSERT_EQUAL(2, commands.size());
+  TEST_ASSERT_EQUAL_STRING("player/play_input?pid=1537612205&input=inputs/usbdac", commands[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("player/set_volume?pid=1537612205&level=25", commands[1].c_str());
+}
+
+namespace {
+  void PressVolumeUp(void * hc){
+    for(int i = 0; i < 100; i++){
+      ((HeosControl *)hc)->VolumeUp();
+      delay(7);
+    }
+    vTaskDelete(NULL);
+  }
+}
+
+void test_scene_is_one_write_with_other_commands(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+  delay(100);
+  server->ClearRecords();
+
+  // Another task queues commands while scenes are committed.
+  xTaskCreatePinnedToCore(PressVolumeUp, "PressVolumeUp", 4096, &hc, 1, nullptr, 0);
+  const int scenes = 50;
+  for(int i = 0; i < scenes; i++){
+    hc.BeginBatch();
+    hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
+    hc.SetVolume(25);
+    hc.Commit();
+    delay(13);
+  }
+  delay(3000);
+  hc.Disconnect();
+
+  const std::string scene = "heos://player/play_input?pid=1537612205&input=inputs/usbdac\r\n"
+                            "heos://player/set_volume?pid=1537612205&level=25\r\n";
+  int scene_writes = 0;
+  for(const MockHeosServer::WRITE & write : server->GetWrites()){
+    if(write.data.find("play_input") != std::string::npos || write.data.find("set_volume") != std::string::npos){
+      TEST_ASSERT_EQUAL_STRING(scene.c_str(), write.data.c_str());
+      scene_writes++;
+    }
+  }
+  TEST_ASSERT_EQUAL(scenes, scene_writes);
+  TEST_ASSERT_EQUAL(100, server->GetCount("player/volume_up"));
+}
+
+void test_only_idempotent_commands_are_resent(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+  delay(100);
+  server->ClearRecords();
+
+  // The device takes the commands but answers neither them nor the heartbeat, as on a
+  // half-open socket. HeosControl reconnects and resends what is safe to run twice.
+  std::vector<RESULT> results;
+  hc.SetResultCallback([&results](HeosControl::COMMAND cmd, bool success){ results.push_back(RESULT{ cmd, success, millis() }); });
+  server->SetSilent(true);
+  hc.BeginBatch();
+  hc.SetVolume(20);
+  hc.VolumeUp();
+  hc.SetMute(true);
+  hc.ToggleMute();
+  hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
+  hc.VolumeDown();
+  hc.Commit();
+  delay(700);
+  server->SetSilent(false);
+  delay(3000);
+  hc.Disconnect();
+
+  TEST_ASSERT_EQUAL(2, server->GetConnectionCount());
+  TEST_ASSERT_EQUAL(2, server->GetCount("player/set_volume"));
+  TEST_ASSERT_EQUAL(2, server->GetCount("player/set_mute"));
+  TEST_ASSERT_EQUAL(2, server->GetCount("player/play_input"));
+  TEST_ASSERT_EQUAL(1, server->GetCount("player/volume_up"));
+  TEST_ASSERT_EQUAL(1, server->GetCount("player/volume_down"));
+  TEST_ASSERT_EQUAL(1, server->GetCount("player/toggle_mute"));
+
+  // Every command is reported once. The ones not resent are failures.
+  TEST_ASSERT_EQUAL(6, results.size());
+  for(const RESULT & result : results){
+    const bool idempotent = result.cmd == HeosControl::COMMAND::SetVolume || result.cmd == HeosControl::COMMAND::SetMute ||
+                            result.cmd == HeosControl::COMMAND::PlayInputSource;
+    TEST_ASSERT_EQUAL(idempotent, result.success);
+  }
+}
+
+void test_result_follows_response(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  std::vector<RESULT> results;
+  hc.SetResultCallback([&results](HeosControl::COMMAND cmd, bool success){ results.push_back(RESULT{ cmd, success, millis() }); });
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+  delay(100);
+
+  // The result comes when the device answers, not when the command is queued.
+  server->SetCommandDelay("player/set_volume", 200);
+  server->SetFailure("player/set_mute", true);
+  const uint32_t press_ms = millis();
+  hc.SetVolume(20);
+  hc.SetMute(true);
+  delay(1000);
+  hc.Disconnect();
+
+  TEST_ASSERT_EQUAL(3, results.size());
+  TEST_ASSERT_EQUAL((int)HeosControl::COMMAND::GetPlayers, (int)results[0].cmd);
+  TEST_ASSERT_TRUE(results[0].success);
+  TEST_ASSERT_EQUAL((int)HeosControl::COMMAND::SetVolume, (int)results[1].cmd);
+  TEST_ASSERT_TRUE(results[1].success);
+  TEST_ASSERT_GREATER_OR_EQUAL(200, results[1].time_ms - press_ms);
+  TEST_ASSERT_EQUAL((int)HeosControl::COMMAND::SetMute, (int)results[2].cmd);
+  TEST_ASSERT_FALSE(results[2].success);
+}
+
+void test_interim_keeps_waiting_after_other_response(void){
+  auto server = std::make_shared<MockHeosServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  std::vector<RESULT> results;
+  hc.SetResultCallback([&results](HeosControl::COMMAND cmd, bool success){
+    if(cmd != HeosControl::COMMAND::GetPlayers){
+      results.push_back(RESULT{ cmd, success, millis() });
+    }
+  });
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+  delay(100);
+
+  // The device answers from the test in the order it does for a slow input switch. A heartbeat
+  // would not be answered, so the final play_input must come within interim_timeout_ms alone.
+  server->SetSilent(true);
+  hc.BeginBatch();
+  hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
+  hc.SetVolume(25);
+  const uint32_t press_ms = millis();
+  hc.Commit();
+  delay(50);
+  const std::string query = "pid=1537612205&input=inputs/usbdac";
+  server->SendLine("{\"heos\": {\"command\": \"player/play_input\", \"result\": \"success\", \"message\": \"command under process&" + query + "\"}}\r\n");
+  server->SendLine(VOLUME_EVENT);
+  server->SendLine("{\"heos\": {\"command\": \"player/set_volume\", \"result\": \"success\", \"message\": \"pid=1537612205&level=25\"}}\r\n");
+  server->SendLine("{\"heos\": {\"command\": \"player/play_input\", \"result\": \"success\", \"message\": \"" + query + "\"}}\r\n", 1500);
+  delay(2000);
+  hc.Disconnect();
+
+  TEST_ASSERT_EQUAL(2, results.size());
+  TEST_ASSERT_EQUAL((int)HeosControl::COMMAND::SetVolume, (int)results[0].cmd);
+  TEST_ASSERT_TRUE(results[0].success);
+  TEST_ASSERT_EQUAL((int)HeosControl::COMMAND::PlayInputSource, (int)results[1].cmd);
+  TEST_ASSERT_TRUE(results[1].success);
+  TEST_ASSERT_GREATER_OR_EQUAL(1500, results[1].time_ms - press_ms);
+  TEST_ASSERT_EQUAL(0, server->GetCount("system/heart_beat"));
+  TEST_ASSERT_EQUAL(1, server->GetCount("player/play_input"));
+  TEST_ASSERT_EQUAL(1, server->GetConnectionCount());
+}
+
+int main(int argc, char ** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_line_continues_after_timeout);
+  RUN_TEST(test_event_split_while_idle);
+  RUN_TEST(test_late_response_during_heartbeat);
+  RUN_TEST(test_scene_is_one_write);
+  RUN_TEST(test_scene_is_one_write_with_other_commands);
+  RUN_TEST(test_only_idempotent_commands_are_resent);
+  RUN_TEST(test_result_follows_response);
+  RUN_TEST(test_interim_keeps_waiting_after_other_response);
+  return UNITY_END();
+}
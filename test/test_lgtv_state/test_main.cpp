@@ -0,0 +1,200 @@
+// Tests of the TvState cache of LgtvControl against MockTv.
+//
+// MockTv pushes the foreground app, the audio status and the external input list the way the
+// TV does, so every update goes through TextHandler and UpdateState of a live connection.
+// Disconnect() comes before the assertions so that a failed test does not leave the handler
+// running on a destroyed LgtvControl.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "NativeNetwork.h"
+#include "LgtvControl.h"
+#include "MockTv.h"
+
+namespace {
+  const IPAddress LGTV_ADDRESS(192,168,1,41);
+  const uint8_t ALL_INPUTS = 0x0f;
+}
+
+void setUp(void){
+  NativeNetwork::Reset();
+}
+
+void tearDown(void){
+}
+
+void test_state_follows_tv_pushes(void){
+  auto tv = std::make_shared<MockTv>();
+  tv->SetInputs({ "HDMI_1", "HDMI_2" });
+  NativeNetwork::Listen(LGTV_ADDRESS, 3000, tv);
+  LgtvControl lc;
+  TEST_ASSERT_TRUE(lc.Connect(LGTV_ADDRESS, MockTv::CLIENT_KEY));
+  delay(500);
+  const LgtvControl::TvState initial = lc.GetState();
+
+  tv->PushApp("com.webos.app.hdmi2");
+  tv->PushAudio(30, true);
+  delay(100);
+  const LgtvControl::TvState pushed = lc.GetState();
+
+  // An app that is not an input is known, but is not any input.
+  tv->PushApp("netflix");
+  tv->SetInputs({ "HDMI_1", "HDMI_2", "HDMI_3", "HDMI_4" });
+  tv->PushInputs();
+  delay(100);
+  const LgtvControl::TvState other = lc.GetState();
+  lc.Disconnect();
+
+  TEST_ASSERT_TRUE(initial.app_known);
+  TEST_ASSERT_EQUAL((int)LgtvControl::InputId::HDMI1, (int)initial.input);
+  TEST_ASSERT_TRUE(initial.audio_known);
+  TEST_ASSERT_EQUAL(12, initial.volume);
+  TEST_ASSERT_FALSE(initial.mute);
+  TEST_ASSERT_TRUE(initial.inputs_known);
+  TEST_ASSERT_EQUAL(0x03, initial.inputs);
+
+  TEST_ASSERT_EQUAL((int)LgtvControl::InputId::HDMI2, (int)pushed.input);
+  TEST_ASSERT_EQUAL(30, pushed.volume);
+  TEST_ASSERT_TRUE(pushed.mute);
+
+  TEST_ASSERT_TRUE(other.app_known);
+  TEST_ASSERT_EQUAL((int)LgtvControl::InputId::Invalid, (int)other.input);
+  TEST_ASSERT_EQUAL(ALL_INPUTS, other.inputs);
+}
+
+void test_switch_to_current_input_sends_nothing(void){
+  auto tv = std::make_shared<MockTv>();
+  NativeNetwork::Listen(LGTV_ADDRESS, 3000, tv);
+  LgtvControl lc;
+  TEST_ASSERT_TRUE(lc.Connect(LGTV_ADDRESS, MockTv::CLIENT_KEY));
+  delay(500);
+
+  const bool current = lc.SwitchInput(LgtvControl::InputId::HDMI1);
+  delay(500);
+  const size_t requests_current = tv->GetSwitchRequests().size();
+
+  // The switch is sent once. The app pushed after it makes the second press a no-op.
+  const bool first = lc.SwitchInput(LgtvControl::InputId::HDMI2);
+  delay(1000);
+  const LgtvControl::InputId input = lc.GetState().input;
+  const bool second = lc.SwitchInput(LgtvControl::InputId::HDMI2);
+  delay(500);
+  lc.Disconnect();
+
+  TEST_ASSERT_TRUE(current);
+  TEST_ASSERT_EQUAL(0, requests_current);
+  TEST_ASSERT_TRUE(first);
+  TEST_ASSERT_TRUE(second);
+  TEST_ASSERT_EQUAL((int)LgtvControl::InputId::HDMI2, (int)input);
+  TEST_ASSERT_EQUAL(1, tv->GetSwitchRequests().size());
+  TEST_ASSERT_EQUAL(1, tv->GetCount("ssap://tv/switchInput"));
+}
+
+void test_unavailable_input_is_rejected(void){
+  auto tv = std::make_shared<MockTv>();
+  tv->SetInputs({ "HDMI_1", "HDMI_2" });
+  NativeNetwork::Listen(LGTV_ADDRESS, 3000, tv);
+  LgtvControl lc;
+  TEST_ASSERT_TRUE(lc.Connect(LGTV_ADDRESS, MockTv::CLIENT_KEY));
+  delay(500);
+
+  const bool rejected = lc.SwitchInput(LgtvControl::InputId::HDMI4);
+  delay(500);
+  const size_t requests_rejected = tv->GetSwitchRequests().size();
+
+  // An input plugged in later is accepted after the TV reports it.
+  tv->SetInputs({ "HDMI_1", "HDMI_2", "HDMI_4" });
+  tv->PushInputs();
+  delay(100);
+  const bool accepted = lc.SwitchInput(LgtvControl::InputId::HDMI4);
+  delay(500);
+  lc.Disconnect();
+
+  TEST_ASSERT_FALSE(rejected);
+  TEST_ASSERT_EQUAL(0, requests_rejected);
+  TEST_ASSERT_TRUE(accepted);
+  const std::vector<std::string> switches = tv->GetSwitchRequests();
+  TEST_ASSERT_EQUAL(1, switches.size());
+  TEST_ASSERT_EQUAL_STRING("HDMI_4", switches[0].c_str());
+}
+
+void test_disconnect_resets_cache(void){
+  auto tv = std::make_shared<MockTv>();
+  tv->SetInputs({ "HDMI_1", "HDMI_2" });
+  NativeNetwork::Listen(LGTV_ADDRESS, 3000, tv);
+  LgtvControl lc;
+  TEST_ASSERT_TRUE(lc.Connect(LGTV_ADDRESS, MockTv::CLIENT_KEY));
+  delay(500);
+
+  // The TV may change input while the connection is down, so the app and the audio are
+  // forgotten. The input list is kept since the same TV comes back.
+  tv->SetRefuse(true);
+  tv->Close();
+  delay(100);
+  const LgtvControl::TvState disconnected = lc.GetState();
+
+  // Without the app the press is sent, even though the TV was on HDMI1 before.
+  const bool queued = lc.SwitchInput(LgtvControl::InputId::HDMI1);
+  const bool rejected = lc.SwitchInput(LgtvControl::InputId::HDMI3);
+  tv->SetRefuse(false);
+  delay(3000);
+  const LgtvControl::TvState reconnected = lc.GetState();
+  lc.Disconnect();
+
+  TEST_ASSERT_FALSE(disconnected.app_known);
+  TEST_ASSERT_FALSE(disconnected.audio_known);
+  TEST_ASSERT_TRUE(disconnected.inputs_known);
+  TEST_ASSERT_EQUAL(0x03, disconnected.inputs);
+  TEST_ASSERT_TRUE(queued);
+  TEST_ASSERT_FALSE(rejected);
+  TEST_ASSERT_EQUAL(2, tv->GetConnectionCount());
+  TEST_ASSERT_EQUAL(1, tv->GetSwitchRequests().size());
+  // The input list is not requested again after reconnecting.
+  TEST_ASSERT_EQUAL(1, tv->GetCount("ssap://tv/getExternalInputList"));
+  TEST_ASSERT_TRUE(reconnected.app_known);
+  TEST_ASSERT_TRUE(reconnected.audio_known);
+}
+
+void test_result_follows_response(void){
+  auto tv = std::make_shared<MockTv>();
+  NativeNetwork::Listen(LGTV_ADDRESS, 3000, tv);
+  LgtvControl lc;
+  std::vector<std::pair<LgtvControl::InputId, bool>> results;
+  uint32_t accepted_ms = 0;
+  lc.SetResultCallback([&](LgtvControl::InputId input, bool success){
+    results.push_back(std::make_pair(input, success));
+    if(success && accepted_ms == 0){
+      accepted_ms = millis();
+    }
+  });
+  TEST_ASSERT_TRUE(lc.Connect(LGTV_ADDRESS, MockTv::CLIENT_KEY));
+  delay(500);
+
+  tv->SetResponseDelay(200);
+  const uint32_t press_ms = millis();
+  lc.SwitchInput(LgtvControl::InputId::HDMI2);
+  delay(1000);
+
+  // HDMI_4 was unplugged without the TV pushing the list, so the TV refuses the switch.
+  tv->SetInputs({ "HDMI_1", "HDMI_2" });
+  lc.SwitchInput(LgtvControl::InputId::HDMI4);
+  delay(1000);
+  lc.Disconnect();
+
+  TEST_ASSERT_EQUAL(2, results.size());
+  TEST_ASSERT_EQUAL((int)LgtvControl::InputId::HDMI2, (int)results[0].first);
+  TEST_ASSERT_TRUE(results[0].second);
+  TEST_ASSERT_GREATER_OR_EQUAL(200, accepted_ms - press_ms);
+  TEST_ASSERT_EQUAL((int)LgtvControl::InputId::HDMI4, (int)results[1].first);
+  TEST_ASSERT_FALSE(results[1].second);
+}
+
+int main(int argc, char ** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_state_follows_tv_pushes);
+  RUN_TEST(test_switch_to_current_input_sends_nothing);
+  RUN_TEST(test_unavailable_input_is_rejected);
+  RUN_TEST(test_disconnect_resets_cache);
+  RUN_TEST(test_result_follows_response);
+  return UNITY_END();
+}
@@ -0,0 +1,169 @@
+// Benchmark of the HEOS and SSAP message handling over the corpus in test/support.
+//
+// Each corpus entry is replayed ROUNDS times through the code used on the device:
+// - HEOS lines are read by WaitJsonResponse() from a socket and passed to RouteMessage(),
+//   which sizes the document, parses and classifies the line and routes events.
+// - SSAP frames are passed to LgtvControl::TextHandler(), which parses through the filter and
+//   updates the cached TV state.
+// - Builders pack the messages sent to the devices.
+// Reported per message: host time, bytes and number of allocations, and the peak heap above
+// what was in use before the entry. Run with: pio test -e native -f test_protocol_bench -v
+//
+// The test fails if a message leaks heap, a guard byte was overwritten, or an allocation did
+// not fit the arena.
+
+#include <Arduino.h>
+#include <chrono>
+#include <unity.h>
+#include "NativeHeap.h"
+#include "NativeNetwork.h"
+#include "HeosControlProbe.h"
+#include "LgtvControlProbe.h"
+#include "ProtocolCorpus.h"
+
+namespace {
+  const IPAddress HEOS_ADDRESS(192,168,1,40);
+  const int ROUNDS = 200;
+  const char * const CLIENT_KEY = "5f1a3c7e9b2d4f6a8c0e1b3d5f7a9c2e";
+
+  // FeedServer only keeps the connection so that the test can send lines to the client.
+  class FeedServer : public NativeServer {
+  public:
+    void OnReceive(const std::shared_ptr<NativeConnection> & connection, const std::string & data) override {
+      (void)connection;
+      (void)data;
+    }
+    bool OnConnect(const std::shared_ptr<NativeConnection> & connection) override {
+      m_connection = connection;
+      return true;
+    }
+    std::shared_ptr<NativeConnection> m_connection;
+  };
+
+  struct RESULT {
+    double ns_per_message = 0;
+    double bytes_per_message = 0;
+    double allocations_per_message = 0;
+    size_t peak_bytes = 0;
+  };
+
+  // Measure runs body once to warm up and then ROUNDS times. body handles messages messages per call.
+  template <typename F>
+  RESULT Measure(const char * name, size_t messages, F body){
+    body();
+
+    NativeHeap::ResetPeak();
+    const NativeHeap::STATS before = NativeHeap::GetStats();
+    const auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < ROUNDS; i++){
+      body();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const NativeHeap::STATS after = NativeHeap::GetStats();
+
+    const double count = (double)ROUNDS * messages;
+    RESULT result;
+    result.ns_per_message = std::chrono::duration<double, std::nano>(end - start).count() / count;
+    result.bytes_per_message = (after.allocated_bytes - before.allocated_bytes) / count;
+    result.allocations_per_message = (after.allocations - before.allocations) / count;
+    result.peak_bytes = after.peak_in_use - before.in_use;
+    printf("  %-32s %9.0f ns/msg %9.1f B/msg %6.2f allocs/msg %7u B peak\n",
+      name, result.ns_per_message, result.bytes_per_message, result.allocations_per_message, (unsigned)result.peak_bytes);
+
+    TEST_ASSERT_EQUAL_MESSAGE(before.in_use, after.in_use, name);
+    TEST_ASSERT_EQUAL_MESSAGE(before.fallback_allocations, after.fallback_allocations, name);
+    TEST_ASSERT_TRUE_MESSAGE(NativeHeap::Verify(), name);
+    return result;
+  }
+}
+
+void setUp(void){
+  NativeNetwork::Reset();
+}
+
+void tearDown(void){
+}
+
+void test_heos_lines(void){
+  auto server = std::make_shared<FeedServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+
+  HeosControl hc;
+  HeosControlProbe probe(hc);
+  int events = 0;
+  hc.AddEventCallback([&events](DynamicJsonDocument doc){ events++; });
+  TEST_ASSERT_TRUE(probe.Attach(HEOS_ADDRESS));
+
+  printf("HEOS lines (framing, parsing, routing)\n");
+  for(const CORPUS_ENTRY & entry : HEOS_CORPUS){
+    // A truncated line is completed by the next line ending on the socket.
+    std::string data = entry.data;
+    if(data.size() < 2 || data.compare(data.size() - 2, 2, "\r\n") != 0){
+      data += "\r\n";
+    }
+    // All copies are sent up front so that the socket buffer is not part of the measurement.
+    std::string stream;
+    for(int i = 0; i <= ROUNDS; i++){
+      stream += data;
+    }
+    server->m_connection->Send(stream);
+    Measure(entry.name, 1, [&](){
+      const String line = probe.WaitJsonResponse(10);
+      probe.RouteMessage(line);
+    });
+  }
+  probe.Detach();
+  TEST_ASSERT_GREATER_THAN(0, events);
+}
+
+void test_ssap_frames(void){
+  LgtvControl lc;
+  LgtvControlProbe probe(lc);
+  probe.SetSubscriptionIds(CORPUS_APP_SUB_ID, CORPUS_AUDIO_SUB_ID, CORPUS_INPUTS_REQ_ID);
+
+  printf("SSAP frames (filtered parsing, state update)\n");
+  for(const CORPUS_ENTRY & entry : SSAP_CORPUS){
+    const size_t length = strlen(entry.data);
+    Measure(entry.name, 1, [&](){
+      probe.TextHandler(entry.data, length);
+    });
+  }
+  TEST_ASSERT_TRUE(lc.GetState().inputs_known);
+  TEST_ASSERT_TRUE(lc.GetState().audio_known);
+}
+
+void test_builders(void){
+  LgtvControl lc;
+  LgtvControlProbe lprobe(lc);
+  HeosControl hc;
+  HeosControlProbe hprobe(hc);
+  hprobe.SetPlayerId(-1265379422);
+
+  printf("Builders\n");
+  lprobe.SetClientKey("");
+  Measure("lgtv register (pairing)", 1, [&](){ lprobe.PackRegisterMessage("abcdef100001", ""); });
+  lprobe.SetClientKey(CLIENT_KEY);
+  Measure("lgtv register (client-key)", 1, [&](){ lprobe.PackRegisterMessage("abcdef100001", CLIENT_KEY); });
+  Measure("lgtv subscribe", 1, [&](){ lprobe.PackSubscribeMessage("abcdef100002", LgtvControlProbe::URI::GetForegroundAppInfo); });
+  Measure("lgtv request", 1, [&](){ lprobe.PackRequestMessage("abcdef100004", LgtvControlProbe::URI::GetExternalInputList); });
+  Measure("lgtv switchInput", 1, [&](){ lprobe.PackSwitchInputMessage("abcdef100005", LgtvControlProbe::InputId::HDMI2); });
+  Measure("heos set_volume", 1, [&](){
+    hc.SetVolume(20);
+    hprobe.ClearQueue();
+  });
+  Measure("heos play_input + set_volume batch", 2, [&](){
+    hc.BeginBatch();
+    hc.PlayInputSource(HeosControl::INPUT_SOURCE::USBDAC);
+    hc.SetVolume(25);
+    hc.Commit();
+    hprobe.ClearQueue();
+  });
+}
+
+int main(int argc, char ** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_heos_lines);
+  RUN_TEST(test_ssap_frames);
+  RUN_TEST(test_builders);
+  return UNITY_END();
+}
@@ -0,0 +1,329 @@
+// Fuzz target for the HEOS and SSAP message handling.
+//
+// The corpus in test/support is replayed first and then mutated with a fixed seed: bytes are
+// flipped, inserted, deleted, duplicated and spliced from other entries. Each input goes
+// through the same entry points as on the device:
+// - HEOS: WaitJsonResponse() on a socket, then a document sized by GetDocumentCapacity() and
+//   ParseMessage(), as WaitResponses() does.
+// - SSAP: LgtvControl::TextHandler() with a buffer of exactly length bytes.
+//
+// Checks:
+// - Input that parses into an unbounded document also parses into the sized one. The old
+//   estimate of 512 + 2 * length bytes failed this for arrays of many short values, and such
+//   responses were dropped as invalid.
+// - Lines longer than max_response_length are dropped and the next line is read cleanly.
+// - The register message keeps the whole pairing manifest.
+// - No guard byte of the heap is overwritten, and the heap returns to where it started.
+//
+// FUZZ_ITERATIONS and FUZZ_SEED can be set with build_flags to run longer or another sequence.
+
+#include <Arduino.h>
+#include <random>
+#include <unity.h>
+#include "NativeHeap.h"
+#include "NativeNetwork.h"
+#include "HeosControlProbe.h"
+#include "LgtvControlProbe.h"
+#include "ProtocolCorpus.h"
+
+#ifndef FUZZ_ITERATIONS
+#define FUZZ_ITERATIONS 20000
+#endif
+
+#ifndef FUZZ_SEED
+#define FUZZ_SEED 20240229
+#endif
+
+namespace {
+  const IPAddress HEOS_ADDRESS(192,168,1,40);
+  const size_t UNBOUNDED_CAPACITY = 1024 * 1024;
+
+  class FeedServer : public NativeServer {
+  public:
+    void OnReceive(const std::shared_ptr<NativeConnection> & connection, const std::string & data) override {
+      (void)connection;
+      (void)data;
+    }
+    bool OnConnect(const std::shared_ptr<NativeConnection> & connection) override {
+      m_connection = connection;
+      return true;
+    }
+    std::shared_ptr<NativeConnection> m_connection;
+  };
+
+  class Mutator {
+  public:
+    explicit Mutator(uint32_t seed) : m_random(seed) {}
+
+    size_t Pick(size_t count){
+      return std::uniform_int_distribution<size_t>(0, count - 1)(m_random);
+    }
+
+    std::string Mutate(std::string data, const CORPUS_ENTRY * corpus, size_t corpus_size){
+      static const char TOKENS[] = "{}[],:\"\\ 0-.eEtfn\r\n\x00\xff";
+      const size_t count = 1 + Pick(4);
+      for(size_t i = 0; i < count; i++){
+        const size_t pos = data.empty() ? 0 : Pick(data.size() + 1);
+        switch(Pick(7)){
+          case 0: // flip a bit
+            if(!data.empty()){
+              data[Pick(data.size())] ^= (char)(1 << Pick(8));
+            }
+            break;
+          case 1: // insert a token
+            data.insert(pos, 1, TOKENS[Pick(sizeof(TOKENS) - 1)]);
+            break;
+          case 2: // delete a range
+            if(!data.empty()){
+              data.erase(Pick(data.size()), 1 + Pick(16));
+            }
+            break;
+          case 3: // duplicate a range
+            if(!data.empty()){
+              const size_t from = Pick(data.size());
+              data.insert(pos, data.substr(from, 1 + Pick(64)));
+            }
+            break;
+          case 4: // truncate
+            data.resize(Pick(data.size() + 1));
+            break;
+          case 5: // splice another entry
+          {
+            const std::string other = corpus[Pick(corpus_size)].data;
+            const size_t from = Pick(other.size() + 1);
+            data.insert(pos, other.substr(from, Pick(other.size() - from + 1)));
+            break;
+          }
+          default: // repeat a structural token to widen or deepen
+          {
+            const char token = "[{,"[Pick(3)];
+            data.insert(pos, 1 + Pick(64), token);
+            break;
+          }
+        }
+      }
+      return data;
+    }
+
+  private:
+    std::mt19937 m_random;
+  };
+
+  // CheckHeosLine parses line as WaitResponses() does.
+  // @return false if line is valid JSON but did not fit the sized document.
+  bool CheckHeosLine(HeosControlProbe & probe, const String & line){
+    DynamicJsonDocument reference(UNBOUNDED_CAPACITY);
+    const bool valid = !deserializeJson(reference, line.c_str());
+    reference.clear();
+
+    DynamicJsonDocument doc(HeosControlProbe::GetDocumentCapacity(line));
+    const DeserializationError error = deserializeJson(doc, line.c_str());
+    if(valid && error){
+      printf("  %s for %u bytes: %.120s\n", error.c_str(), (unsigned)line.length(), line.c_str());
+      return false;
+    }
+    probe.ParseMessage(line, doc);
+    return true;
+  }
+
+  // FeedHeos sends data as one line and reads it back through WaitJsonResponse().
+  String FeedHeos(FeedServer & server, HeosControlProbe & probe, std::string data){
+    // A newline inside data would split it into several lines. They are read one by one.
+    data += "\r\n";
+    server.m_connection->Send(data);
+    String line = probe.WaitJsonResponse(10);
+    String rest;
+    while(!(rest = probe.WaitJsonResponse(0)).isEmpty()){
+      line = rest;
+    }
+    return line;
+  }
+}
+
+void setUp(void){
+  NativeNetwork::Reset();
+}
+
+void tearDown(void){
+}
+
+void test_heos_corpus_fits_documents(void){
+  HeosControl hc;
+  HeosControlProbe probe(hc);
+
+  for(const CORPUS_ENTRY & entry : HEOS_CORPUS){
+    const String line(entry.data);
+    DynamicJsonDocument doc(HeosControlProbe::GetDocumentCapacity(line));
+    const DeserializationError error = deserializeJson(doc, line.c_str());
+    if(entry.valid){
+      TEST_ASSERT_FALSE_MESSAGE(error, entry.name);
+    }else{
+      TEST_ASSERT_TRUE_MESSAGE(error != DeserializationError::NoMemory, entry.name);
+    }
+  }
+
+  // Classification of the entries that were dropped as invalid before.
+  DynamicJsonDocument doc(HeosControlProbe::GetDocumentCapacity(HEOS_CORPUS[9].data));
+  TEST_ASSERT_EQUAL_STRING("get_players_8", HEOS_CORPUS[9].name);
+  TEST_ASSERT_TRUE(probe.ParseMessage(HEOS_CORPUS[9].data, doc) == HeosControlProbe::MESSAGE::Response);
+  TEST_ASSERT_EQUAL(8, doc["payload"].size());
+  TEST_ASSERT_EQUAL(119348720, doc["payload"][7]["pid"].as<long>());
+}
+
+void test_heos_small_lines_take_less_than_before(void){
+  // Acks are most of the traffic. They now get a document of a few hundred bytes instead of
+  // 512 + 2 * length.
+  const String line(HEOS_CORPUS[0].data);
+  TEST_ASSERT_LESS_THAN(512 + line.length() * 2, HeosControlProbe::GetDocumentCapacity(line));
+}
+
+void test_heos_long_line_is_dropped(void){
+  auto server = std::make_shared<FeedServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  HeosControlProbe probe(hc);
+  TEST_ASSERT_TRUE(probe.Attach(HEOS_ADDRESS));
+
+  // 64 KB without a line break, then a normal ack.
+  std::string flood = "{\"heos\": {\"command\": \"player/get_players\", \"message\": \"";
+  flood.append(64 * 1024, 'x');
+  flood += "\"}}\r\n";
+  server->m_connection->Send(flood);
+  server->m_connection->Send(HEOS_CORPUS[0].data);
+
+  // The flood itself sits in the socket buffer, so the peak is taken from here.
+  const NativeHeap::STATS before = NativeHeap::GetStats();
+  NativeHeap::ResetPeak();
+
+  TEST_ASSERT_TRUE(probe.WaitJsonResponse(100).isEmpty());
+  const String next = probe.WaitJsonResponse(100);
+  TEST_ASSERT_EQUAL_STRING(HEOS_CORPUS[0].data, next.c_str());
+
+  // The line buffer stops growing at max_response_length.
+  const NativeHeap::STATS after = NativeHeap::GetStats();
+  TEST_ASSERT_LESS_THAN(16 * 1024, after.peak_in_use - before.in_use);
+  probe.Detach();
+}
+
+void test_register_message_keeps_manifest(void){
+  LgtvControl lc;
+  LgtvControlProbe probe(lc);
+  probe.SetClientKey("");
+
+  const String message = probe.PackRegisterMessage("abcdef100001", "");
+  DynamicJsonDocument doc(UNBOUNDED_CAPACITY);
+  TEST_ASSERT_FALSE(deserializeJson(doc, message.c_str()));
+  TEST_ASSERT_EQUAL_STRING("register", doc["type"].as<const char *>());
+  TEST_ASSERT_EQUAL_STRING("abcdef100001", doc["id"].as<const char *>());
+  TEST_ASSERT_EQUAL_STRING("PROMPT", doc["payload"]["pairingType"].as<const char *>());
+  JsonArray permissions = doc["payload"]["manifest"]["permissions"];
+  TEST_ASSERT_EQUAL(52, permissions.size());
+  TEST_ASSERT_EQUAL_STRING("CONTROL_WOL", permissions[51].as<const char *>());
+  const String signature = doc["payload"]["manifest"]["signatures"][0]["signature"].as<String>();
+  TEST_ASSERT_TRUE(signature.endsWith("NQnAtw=="));
+
+  probe.SetClientKey("5f1a3c7e9b2d4f6a8c0e1b3d5f7a9c2e");
+  const String keyed = probe.PackRegisterMessage("abcdef100009", "5f1a3c7e9b2d4f6a8c0e1b3d5f7a9c2e");
+  TEST_ASSERT_FALSE(deserializeJson(doc, keyed.c_str()));
+  TEST_ASSERT_EQUAL_STRING("5f1a3c7e9b2d4f6a8c0e1b3d5f7a9c2e", doc["payload"]["client-key"].as<const char *>());
+}
+
+void test_ssap_corpus_updates_state(void){
+  LgtvControl lc;
+  LgtvControlProbe probe(lc);
+  probe.SetSubscriptionIds(CORPUS_APP_SUB_ID, CORPUS_AUDIO_SUB_ID, CORPUS_INPUTS_REQ_ID);
+
+  for(const CORPUS_ENTRY & entry : SSAP_CORPUS){
+    probe.TextHandler(entry.data, strlen(entry.data));
+    if(strcmp(entry.name, "foreground_app_hdmi1") == 0){
+      TEST_ASSERT_TRUE(lc.GetState().app_known);
+      TEST_ASSERT_TRUE(lc.GetState().input == LgtvControl::InputId::HDMI1);
+    }else if(strcmp(entry.name, "audio_status_webos6") == 0){
+      TEST_ASSERT_EQUAL(15, lc.GetState().volume);
+      TEST_ASSERT_TRUE(lc.GetState().mute);
+    }else if(strcmp(entry.name, "external_input_list") == 0){
+      TEST_ASSERT_EQUAL(0x0F, lc.GetState().inputs);
+    }
+  }
+  // Malformed frames after them did not change what was known.
+  TEST_ASSERT_TRUE(lc.GetState().inputs_known);
+  TEST_ASSERT_EQUAL(0x0F, lc.GetState().inputs);
+}
+
+void test_fuzz_heos(void){
+  auto server = std::make_shared<FeedServer>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  HeosControl hc;
+  HeosControlProbe probe(hc);
+  int events = 0;
+  hc.AddEventCallback([&events](DynamicJsonDocument doc){ events++; });
+  TEST_ASSERT_TRUE(probe.Attach(HEOS_ADDRESS));
+
+  // The first round warms up static tables, so the heap is compared from the second one.
+  Mutator mutator(FUZZ_SEED);
+  NativeHeap::STATS before;
+  int failures = 0;
+  for(int i = 0; i < FUZZ_ITERATIONS + 1; i++){
+    if(i == 1){
+      before = NativeHeap::GetStats();
+    }
+    const CORPUS_ENTRY & entry = HEOS_CORPUS[mutator.Pick(HEOS_CORPUS_SIZE)];
+    const std::string input = i == 0 ? std::string(entry.data) : mutator.Mutate(entry.data, HEOS_CORPUS, HEOS_CORPUS_SIZE);
+
+    const String line = FeedHeos(*server, probe, input);
+    if(!CheckHeosLine(probe, line)){
+      failures++;
+    }
+    probe.RouteMessage(line);
+
+    if(i % 1024 == 0){
+      TEST_ASSERT_TRUE(NativeHeap::Verify());
+    }
+  }
+  probe.Detach();
+
+  const NativeHeap::STATS after = NativeHeap::GetStats();
+  TEST_ASSERT_EQUAL(0, failures);
+  TEST_ASSERT_TRUE(NativeHeap::Verify());
+  TEST_ASSERT_EQUAL(before.fallback_allocations, after.fallback_allocations);
+  TEST_ASSERT_LESS_OR_EQUAL(before.in_use, after.in_use);
+}
+
+void test_fuzz_ssap(void){
+  LgtvControl lc;
+  LgtvControlProbe probe(lc);
+  probe.SetSubscriptionIds(CORPUS_APP_SUB_ID, CORPUS_AUDIO_SUB_ID, CORPUS_INPUTS_REQ_ID);
+
+  Mutator mutator(FUZZ_SEED + 1);
+  probe.TextHandler(SSAP_CORPUS[0].data, strlen(SSAP_CORPUS[0].data));
+  const NativeHeap::STATS before = NativeHeap::GetStats();
+  for(int i = 0; i < FUZZ_ITERATIONS; i++){
+    const CORPUS_ENTRY & entry = SSAP_CORPUS[mutator.Pick(SSAP_CORPUS_SIZE)];
+    const std::string input = mutator.Mutate(entry.data, SSAP_CORPUS, SSAP_CORPUS_SIZE);
+    probe.TextHandler(input.data(), input.size());
+
+    const LgtvControl::TvState & state = lc.GetState();
+    TEST_ASSERT_TRUE((int)state.input <= (int)LgtvControl::InputId::Invalid);
+    TEST_ASSERT_TRUE(state.inputs <= 0x0F);
+    if(i % 1024 == 0){
+      TEST_ASSERT_TRUE(NativeHeap::Verify());
+    }
+  }
+
+  const NativeHeap::STATS after = NativeHeap::GetStats();
+  TEST_ASSERT_TRUE(NativeHeap::Verify());
+  TEST_ASSERT_EQUAL(before.fallback_allocations, after.fallback_allocations);
+  TEST_ASSERT_EQUAL(before.in_use, after.in_use);
+}
+
+int main(int argc, char ** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_heos_corpus_fits_documents);
+  RUN_TEST(test_heos_small_lines_take_less_than_before);
+  RUN_TEST(test_heos_long_line_is_dropped);
+  RUN_TEST(test_register_message_keeps_manifest);
+  RUN_TEST(test_ssap_corpus_updates_state);
+  RUN_TEST(test_fuzz_heos);
+  RUN_TEST(test_fuzz_ssap);
+  return UNITY_END();
+}
@@ -0,0 +1,171 @@
+// Soak test of the button macros against MockHeosServer and MockTv.
+//
+// The macros of main.cpp are pressed in turn from the test task every 100 ms of virtual time,
+// as the loop task does. The baseline is taken after a warm-up. After every SOAK_BLOCK presses
+// the controllers go idle and Diagnostics::Check() fails the test if the heap in use, the
+// largest free block, the live blocks or a stack high-water mark drifted beyond LIMITS.
+// Add -DSOAK_PRESSES=<n> to build_flags to run longer.
+
+#include <Arduino.h>
+#include <unity.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "NativeHeap.h"
+#include "NativeNetwork.h"
+#include "Diagnostics.h"
+#include "Macros.h"
+#include "MockHeosServer.h"
+#include "MockTv.h"
+
+#ifndef SOAK_PRESSES
+#define SOAK_PRESSES 100000
+#endif
+
+#ifndef SOAK_BLOCK
+#define SOAK_BLOCK 1000
+#endif
+
+namespace {
+  const IPAddress HEOS_ADDRESS(192,168,1,40);
+  const IPAddress LGTV_ADDRESS(192,168,1,41);
+  const int MACRO_COUNT = (int)Macros::MACRO::Invalid;
+  const int WARMUP_PRESSES = 10 * MACRO_COUNT;
+
+  Diagnostics::LIMITS GetLimits(){
+    Diagnostics::LIMITS limits;
+    // An empty std::deque keeps one or two node buffers of about 512 B, depending on where its
+    // cursor stopped, so a sample may find one more node per task queue than the baseline.
+    limits.heap_allocated_growth = 1024;
+    // The task queues free and allocate their deque nodes every few presses, and first-fit
+    // places them anywhere below the tail. Over 300000 presses the largest free block swings
+    // up to 25 KB below the baseline and comes back, while fragmentation would keep growing.
+    limits.largest_free_block_loss = 32768;
+    limits.allocated_blocks_growth = 4;
+    limits.stack_high_water_loss = 256;
+    return limits;
+  }
+
+  // CheckQuietly prints what Check() finds even though Serial is off in the tests.
+  bool CheckQuietly(Diagnostics & diag, const Diagnostics::LIMITS & limits){
+    const bool enabled = NativeSerial::IsEnabled();
+    NativeSerial::SetEnabled(true);
+    const bool ok = diag.Check(limits);
+    NativeSerial::SetEnabled(enabled);
+    return ok;
+  }
+}
+
+void setUp(void){
+  NativeNetwork::Reset();
+}
+
+void tearDown(void){
+}
+
+void test_macros_do_not_drift(void){
+  auto server = std::make_shared<MockHeosServer>();
+  auto tv = std::make_shared<MockTv>();
+  NativeNetwork::Listen(HEOS_ADDRESS, 1255, server);
+  NativeNetwork::Listen(LGTV_ADDRESS, 3000, tv);
+  // MockTv sends the app after a switch on the same ordered stream, so a long switch delay
+  // would hold back the responses to the presses that follow it.
+  tv->SetSwitchDelay(20);
+  // Every switch is sent, since the TV is never on the input of the next TV macro.
+  tv->SetApp("com.webos.app.livetv");
+
+  HeosControl hc;
+  LgtvControl lc;
+  int answered = 0;
+  int failed = 0;
+  hc.SetResultCallback([&](HeosControl::COMMAND cmd, bool success){
+    if(cmd != HeosControl::COMMAND::GetPlayers){
+      success ? answered++ : failed++;
+    }
+  });
+  lc.SetResultCallback([&](LgtvControl::InputId input, bool success){ success ? answered++ : failed++; });
+  TEST_ASSERT_TRUE(hc.Connect(HEOS_ADDRESS));
+  TEST_ASSERT_TRUE(lc.Connect(LGTV_ADDRESS, MockTv::CLIENT_KEY));
+
+  Macros macros(hc, lc);
+  Diagnostics diag;
+  const TaskHandle_t test_task = xTaskGetCurrentTaskHandle();
+  diag.AddStack("HeosControl", [&hc](){ return hc.GetStackHighWaterMark(); });
+  diag.AddStack("LgtvControl", [&lc](){ return lc.GetStackHighWaterMark(); });
+  diag.AddStack("test", [test_task](){ return (uint32_t)uxTaskGetStackHighWaterMark(test_task); });
+
+  int queued = 0;
+  // The mocks record every command. Records are cleared so that only the controllers are measured.
+  for(int i = 0; i < WARMUP_PRESSES; i++){
+    queued += macros.Run((Macros::MACRO)(i % MACRO_COUNT)) ? 1 : 0;
+    delay(100);
+    server->ClearRecords();
+    tv->ClearRecords();
+  }
+  delay(1000);
+  diag.Sample();
+  const NativeHeap::STATS before = NativeHeap::GetStats();
+
+  // A drift that comes back before the end is caught by the sample of its block.
+  int presses = 0;
+  int failed_block = -1;
+  while(presses < SOAK_PRESSES && failed_block < 0){
+    for(int i = 0; i < SOAK_BLOCK && presses < SOAK_PRESSES; i++, presses++){
+      queued += macros.Run((Macros::MACRO)(presses % MACRO_COUNT)) ? 1 : 0;
+      delay(100);
+      server->ClearRecords();
+      tv->ClearRecords();
+    }
+    delay(1000);
+    if(!CheckQuietly(diag, GetLimits())){
+      failed_block = (presses - 1) / SOAK_BLOCK;
+      printf("  Limits exceeded after %d presses\n", presses);
+    }
+  }
+  const NativeHeap::STATS after = NativeHeap::GetStats();
+  printf("  %d presses: %.1f allocs/press, %u B in use, %u B largest free block\n", presses,
+    (double)(after.allocations - before.allocations) / presses, (unsigned)after.in_use, (unsigned)after.largest_free_block);
+  printf("  stack high-water: HeosControl %u B, LgtvControl %u B\n",
+    (unsigned)hc.GetStackHighWaterMark(), (unsigned)lc.GetStackHighWaterMark());
+
+  hc.Disconnect();
+  lc.Disconnect();
+
+  TEST_ASSERT_EQUAL(-1, failed_block);
+  TEST_ASSERT_TRUE(NativeHeap::Verify());
+  TEST_ASSERT_EQUAL(0, after.fallback_allocations);
+  TEST_ASSERT_EQUAL(WARMUP_PRESSES + SOAK_PRESSES, queued);
+  TEST_ASSERT_EQUAL(0, failed);
+  // A HEOS scene is two commands.
+  const int total = WARMUP_PRESSES + SOAK_PRESSES;
+  const int scenes = total / MACRO_COUNT * 2 + (total % MACRO_COUNT > 1 ? 1 : 0) + (total % MACRO_COUNT > 2 ? 1 : 0);
+  TEST_ASSERT_EQUAL(total + scenes, answered);
+  TEST_ASSERT_EQUAL(1, server->GetConnectionCount());
+  TEST_ASSERT_EQUAL(1, tv->GetConnectionCount());
+}
+
+void test_check_catches_a_leak(void){
+  Diagnostics diag;
+  uint32_t high_water = 2048;
+  diag.AddStack("fake", [&high_water](){ return high_water; });
+  diag.Sample();
+  TEST_ASSERT_TRUE(CheckQuietly(diag, GetLimits()));
+
+  // volatile keeps the compiler from removing the pair of malloc and free.
+  void * volatile leak = malloc(4096);
+  TEST_ASSERT_FALSE(CheckQuietly(diag, GetLimits()));
+  free(leak);
+  TEST_ASSERT_TRUE(CheckQuietly(diag, GetLimits()));
+
+  high_water = 1024;
+  TEST_ASSERT_FALSE(CheckQuietly(diag, GetLimits()));
+}
+
+int main(int argc, char ** argv){
+  // stdout would allocate its buffer from the arena at the first output and move the baseline.
+  static char stdout_buffer[BUFSIZ];
+  setvbuf(stdout, stdout_buffer, _IOLBF, sizeof(stdout_buffer));
+  UNITY_BEGIN();
+  RUN_TEST(test_check_catches_a_leak);
+  RUN_TEST(test_macros_do_not_drift);
+  return UNITY_END();
+}